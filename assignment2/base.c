@@ -10,6 +10,7 @@
 #include <time.h>
 
 #include "common.h"
+#include "metrics.h"
 
 // global arr for thread to store its satellite readings
 SatelliteReading infrared_readings[30];
@@ -46,6 +47,14 @@ void base_station(int base_station_world_rank, int max_iterations, int rows,
     pthread_t tid;
     // spin up infrared thread
     pthread_create(&tid, NULL, infrared_thread, (void*)&t_args);
+    // spin up thread serving live counters on a unix socket
+    MetricsThreadArgs m_args;
+    m_args.rows = rows;
+    m_args.cols = cols;
+    // the same start as mpi_start_wtime, moved onto the thread's clock
+    m_args.start_time = metrics_now() - (MPI_Wtime() - mpi_start_wtime);
+    pthread_t metrics_tid;
+    pthread_create(&metrics_tid, NULL, metrics_thread, (void*)&m_args);
     int messages_available;
     int iteration = 0, true_events = 0, false_events = 0;
     // if this file exists in pwd then terminate
@@ -58,6 +67,7 @@ void base_station(int base_station_world_rank, int max_iterations, int rows,
         // check if a ground station has sent a message
         MPI_Iprobe(MPI_ANY_SOURCE, EVENT_MSG_TAG, MPI_COMM_WORLD,
                    &messages_available, MPI_STATUS_IGNORE);
+        long queue_depth = 0;
         while (messages_available) {
             // recv and process ground station messages
             GroundMessage g_msg;
@@ -69,11 +79,14 @@ void base_station(int base_station_world_rank, int max_iterations, int rows,
                 process_ground_message(log_fp, &g_msg, recv_time);
             true_events += 1 & is_true_alert;
             false_events += 1 & !is_true_alert;
+            metrics_record_event(g_msg.coords, rows, cols, is_true_alert);
+            ++queue_depth;
 
             // keep checking if more messages available
             MPI_Iprobe(MPI_ANY_SOURCE, EVENT_MSG_TAG, MPI_COMM_WORLD,
                        &messages_available, MPI_STATUS_IGNORE);
         }
+        metrics_record_queue_depth(queue_depth);
 
         sleep_until_interval(start_time, INTERVAL_MILLISECONDS,
                              mpi_start_wtime);
@@ -89,6 +102,8 @@ void base_station(int base_station_world_rank, int max_iterations, int rows,
     // hence must wait, even though essentially same as normal Bcast
     MPI_Wait(&bcast_req, MPI_STATUS_IGNORE);
     pthread_join(tid, NULL);
+    metrics_stop();
+    pthread_join(metrics_tid, NULL);
 
     double prog_duration_seconds = MPI_Wtime() - mpi_start_wtime;
 
@@ -230,6 +245,8 @@ int compare_satellite_readings(GroundMessage* g_msg, SatelliteReading* out_sr) {
 
         ++i;
     }
+    // i is how many entries were compared before stopping
+    metrics_record_lookup(found_reading, (long)i);
 
     return found_reading;
 }
@@ -0,0 +1,173 @@
+#include "metrics.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// counters shared between the base station and the metrics thread
+BaseMetrics base_metrics;
+
+// flag to indicate whether metrics thread should terminate
+static int metrics_terminate = 0;
+
+static void metrics_add(long* counter, long value) {
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static long metrics_load(long* counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+double metrics_now(void) {
+    // seconds on a monotonic clock, for timing from the metrics thread
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void metrics_record_event(int coords[2], int rows, int cols,
+                          int is_true_alert) {
+    // which block of the grid the reporting node falls in
+    int region_row = coords[0] * METRICS_REGION_ROWS / rows;
+    int region_col = coords[1] * METRICS_REGION_COLS / cols;
+    int region = region_row * METRICS_REGION_COLS + region_col;
+
+    metrics_add(&base_metrics.events, 1);
+    if (is_true_alert) {
+        metrics_add(&base_metrics.true_events, 1);
+        metrics_add(base_metrics.region_true + region, 1);
+    } else {
+        metrics_add(&base_metrics.false_events, 1);
+        metrics_add(base_metrics.region_false + region, 1);
+    }
+}
+
+void metrics_record_lookup(int hit, long probes) {
+    metrics_add(&base_metrics.satellite_lookups, 1);
+    metrics_add(&base_metrics.satellite_hits, hit != 0);
+    metrics_add(&base_metrics.satellite_probes, probes);
+}
+
+void metrics_record_queue_depth(long depth) {
+    __atomic_store_n(&base_metrics.queue_depth, depth, __ATOMIC_RELAXED);
+    // only the base station main thread writes, so no CAS loop needed
+    if (depth > metrics_load(&base_metrics.max_queue_depth))
+        __atomic_store_n(&base_metrics.max_queue_depth, depth,
+                         __ATOMIC_RELAXED);
+}
+
+int metrics_format(char* out_buf, size_t out_buf_len, int rows, int cols,
+                   double elapsed) {
+    long events = metrics_load(&base_metrics.events);
+    long lookups = metrics_load(&base_metrics.satellite_lookups);
+    long hits = metrics_load(&base_metrics.satellite_hits);
+    long probes = metrics_load(&base_metrics.satellite_probes);
+    // avoid dividing by zero right after startup
+    double secs = elapsed > 0.0 ? elapsed : 1.0;
+    int b = 0;
+
+    b += snprintf(out_buf + b, out_buf_len - b, "uptime_seconds %.3f\n",
+                  elapsed);
+    b += snprintf(out_buf + b, out_buf_len - b, "events %ld\n", events);
+    b += snprintf(out_buf + b, out_buf_len - b, "events_per_second %.3f\n",
+                  events / secs);
+    b += snprintf(out_buf + b, out_buf_len - b, "true_events %ld\n",
+                  metrics_load(&base_metrics.true_events));
+    b += snprintf(out_buf + b, out_buf_len - b, "false_events %ld\n",
+                  metrics_load(&base_metrics.false_events));
+    b += snprintf(out_buf + b, out_buf_len - b, "queue_depth %ld\n",
+                  metrics_load(&base_metrics.queue_depth));
+    b += snprintf(out_buf + b, out_buf_len - b, "max_queue_depth %ld\n",
+                  metrics_load(&base_metrics.max_queue_depth));
+    b += snprintf(out_buf + b, out_buf_len - b, "satellite_lookups %ld\n",
+                  lookups);
+    b += snprintf(out_buf + b, out_buf_len - b, "satellite_hit_rate %.3f\n",
+                  lookups ? (double)hits / lookups : 0.0);
+    b += snprintf(out_buf + b, out_buf_len - b,
+                  "satellite_probes_per_lookup %.3f\n",
+                  lookups ? (double)probes / lookups : 0.0);
+
+    // per region alert rates, rows of the grid by region first
+    for (int i = 0; i < METRICS_REGIONS; ++i) {
+        int region_row = i / METRICS_REGION_COLS;
+        int region_col = i % METRICS_REGION_COLS;
+        // grid row/col range covered by this region (inclusive)
+        int row_lo = (region_row * rows + METRICS_REGION_ROWS - 1) /
+                     METRICS_REGION_ROWS;
+        int row_hi = ((region_row + 1) * rows + METRICS_REGION_ROWS - 1) /
+                         METRICS_REGION_ROWS -
+                     1;
+        int col_lo = (region_col * cols + METRICS_REGION_COLS - 1) /
+                     METRICS_REGION_COLS;
+        int col_hi = ((region_col + 1) * cols + METRICS_REGION_COLS - 1) /
+                         METRICS_REGION_COLS -
+                     1;
+        // grid smaller than the region split, nothing maps here
+        if (row_lo > row_hi || col_lo > col_hi) continue;
+        long region_true = metrics_load(base_metrics.region_true + i);
+        long region_false = metrics_load(base_metrics.region_false + i);
+        b += snprintf(out_buf + b, out_buf_len - b,
+                      "region rows=%d-%d cols=%d-%d true_per_second %.3f "
+                      "false_per_second %.3f\n",
+                      row_lo, row_hi, col_lo, col_hi, region_true / secs,
+                      region_false / secs);
+    }
+    return b;
+}
+
+void* metrics_thread(void* arg) {
+    MetricsThreadArgs* t_args = (MetricsThreadArgs*)arg;
+    char reply[2048];
+    struct sockaddr_un addr;
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd == -1) {
+        perror("metrics socket");
+        return arg;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, METRICS_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    // left behind if a previous run was killed
+    unlink(METRICS_SOCKET_PATH);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+        listen(listen_fd, 8) == -1) {
+        perror("metrics bind");
+        close(listen_fd);
+        return arg;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+    while (!__atomic_load_n(&metrics_terminate, __ATOMIC_RELAXED)) {
+        // wake up periodically to check for termination
+        if (poll(&pfd, 1, METRICS_POLL_MILLISECONDS) <= 0) continue;
+
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd == -1) continue;
+        // one snapshot per connection, then hang up
+        int len = metrics_format(reply, sizeof(reply), t_args->rows,
+                                 t_args->cols,
+                                 metrics_now() - t_args->start_time);
+        if (len > (int)sizeof(reply) - 1) len = sizeof(reply) - 1;
+        // a client that hangs up early mustn't SIGPIPE the whole rank
+        for (int sent = 0, w; sent < len; sent += w) {
+            w = send(client_fd, reply + sent, len - sent, MSG_NOSIGNAL);
+            if (w <= 0) break;
+        }
+        close(client_fd);
+    }
+
+    close(listen_fd);
+    unlink(METRICS_SOCKET_PATH);
+    return arg;
+}
+
+void metrics_stop(void) {
+    __atomic_store_n(&metrics_terminate, 1, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,47 @@
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <stddef.h>
+
+// unix socket the base station serves live counters on
+#define METRICS_SOCKET_PATH "base_station.sock"
+// grid is split into METRICS_REGION_ROWS x METRICS_REGION_COLS regions
+#define METRICS_REGION_ROWS 2
+#define METRICS_REGION_COLS 2
+#define METRICS_REGIONS (METRICS_REGION_ROWS * METRICS_REGION_COLS)
+// how often the metrics thread checks whether it should terminate
+#define METRICS_POLL_MILLISECONDS 100
+
+typedef struct {
+    // only ever written by the base station main thread, read by the metrics
+    // thread, so every access goes through __atomic builtins
+    long events;
+    long true_events;
+    long false_events;
+    long queue_depth;      // msgs drained in most recent iteration
+    long max_queue_depth;  // most msgs drained in a single iteration
+    long satellite_lookups;
+    long satellite_hits;
+    long satellite_probes;  // store entries compared across all lookups
+    long region_true[METRICS_REGIONS];
+    long region_false[METRICS_REGIONS];
+} BaseMetrics;
+
+typedef struct {
+    int rows;
+    int cols;
+    // program start on metrics_now's clock, the thread can't call MPI
+    double start_time;
+} MetricsThreadArgs;
+
+extern BaseMetrics base_metrics;
+
+double metrics_now(void);
+void metrics_record_event(int[2], int, int, int);
+void metrics_record_lookup(int, long);
+void metrics_record_queue_depth(long);
+int metrics_format(char*, size_t, int, int, double);
+void* metrics_thread(void*);
+void metrics_stop(void);
+
+#endif
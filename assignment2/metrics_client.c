@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+int query_metrics(const char*);
+
+int main(int argc, char* argv[]) {
+    // interval = seconds between polls, omit to query once
+    if (argc > 3) {
+        printf("Usage: %s [interval_seconds] [socket_path]\n", argv[0]);
+        return 1;
+    }
+
+    double interval = 0.0;
+    if (argc >= 2) {
+        char* ptr;
+        interval = strtod(argv[1], &ptr);
+        if (ptr == argv[1] || interval < 0.0) {
+            printf("Couldn't parse interval: %s\n", argv[1]);
+            return 1;
+        }
+    }
+    const char* socket_path = argc == 3 ? argv[2] : METRICS_SOCKET_PATH;
+
+    if (interval == 0.0) return query_metrics(socket_path);
+
+    struct timespec ts;
+    ts.tv_sec = (time_t)interval;
+    ts.tv_nsec = (long)((interval - (double)ts.tv_sec) * 1000000000.0);
+    // keep polling until the base station goes away
+    while (!query_metrics(socket_path)) {
+        printf("--------------------\n");
+        fflush(stdout);
+        nanosleep(&ts, NULL);
+    }
+    return 0;
+}
+
+int query_metrics(const char* socket_path) {
+    struct sockaddr_un addr;
+    char buf[4096];
+    ssize_t r;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        printf("Could not connect to %s, is the base station running?\n",
+               socket_path);
+        close(fd);
+        return 1;
+    }
+
+    // base station writes one snapshot then closes
+    while ((r = read(fd, buf, sizeof(buf))) > 0) fwrite(buf, 1, r, stdout);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,143 @@
+#!/bin/sh
+# runs every prime finder over N x WORKERS, checks they all find the same
+# primes (count plus an order independent checksum of the output files)
+# and writes compute/output times, speedup and efficiency as csv
+#   usage: bench.sh [out.csv]
+#   N, WORKERS, MPIRUN and SERIAL_MAX come from the environment
+# speedup_vs_serial compares compute time with serial at the same n,
+# speedup/efficiency compare with the same engine at the first worker count
+
+N=${N:-"1000000 10000000"}
+WORKERS=${WORKERS:-"1 2 4"}
+MPIRUN=${MPIRUN:-mpirun}
+# serial tests every number on its own, skip it past this n
+SERIAL_MAX=${SERIAL_MAX:-100000000}
+ENGINES="serial parallel count gathered distributed mpiio hybrid"
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$HERE")
+OUT=$(cd "$(dirname "${1:-bench.csv}")" && pwd)/$(basename "${1:-bench.csv}")
+LAB3=$ROOT/lab_week3
+LAB6=$ROOT/lab_week6
+SUM=$HERE/primesum
+
+# engines write their files in here rather than into the source tree
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+# number following a label at the start of a line of the engine's output
+field() {
+    sed -n "s/^$1 *\([0-9.]*\).*/\1/p" log | head -n 1
+}
+
+# a / b, empty when b is 0 (tiny n can time as 0)
+ratio() {
+    awk -v a="$1" -v b="$2" 'BEGIN { if (b > 0) printf "%.3f", a / b }'
+}
+
+# runs one engine, sets COMPUTE, OUTPUT, COUNT and CHECKSUM
+run() {
+    rm -f primes*.txt log
+    case $1 in
+        serial)
+            # lists primes <= n, the others primes < n
+            echo $(($2 - 1)) | "$LAB3/serial" > log || return 1
+            COMPUTE=$(sed -n 1p log)
+            OUTPUT=$(awk -v t="$(sed -n 2p log)" -v c="$COMPUTE" \
+                'BEGIN { printf "%.6f", t - c }')
+            ;;
+        parallel)
+            "$LAB3/parallel" "$2" "$3" > log || return 1
+            COMPUTE=$(field "Finding primes:")
+            OUTPUT=$(field "Writing to file:")
+            ;;
+        count)
+            "$LAB3/parallel" -c "$2" "$3" > log || return 1
+            COMPUTE=$(field "Counting primes:")
+            OUTPUT=0
+            ;;
+        gathered | distributed | mpiio)
+            echo "$2" | $MPIRUN -np "$3" "$LAB6/primes_$1_save" > log ||
+                return 1
+            COMPUTE=$(field "Compute time (s):")
+            OUTPUT=$(field "Output time (s):")
+            ;;
+        hybrid)
+            # one rank, threads, scale out is covered by make scaling
+            $MPIRUN -np 1 "$LAB6/primes_hybrid" -w -t "$3" "$2" > log ||
+                return 1
+            COMPUTE=$(field "Compute time (s):")
+            OUTPUT=$(field "Output time (s):")
+            ;;
+    esac
+    if [ "$1" = count ]; then
+        COUNT=$(sed -n 's/^Found \([0-9]*\) primes.*/\1/p' log)
+        CHECKSUM=-
+    elif ls primes*.txt > /dev/null 2>&1; then
+        set -- $("$SUM" primes*.txt)
+        COUNT=$1
+        CHECKSUM=$2
+    else
+        COUNT=0
+        CHECKSUM=0000000000000000
+    fi
+}
+
+echo "engine,n,workers,compute_s,output_s,total_s,count,checksum,match,speedup_vs_serial,speedup,efficiency" > "$OUT"
+status=0
+for n in $N; do
+    REF_COUNT=
+    REF_SUM=
+    SERIAL_T=
+    for engine in $ENGINES; do
+        BASE_T=
+        BASE_W=
+        for w in $WORKERS; do
+            if [ $engine = serial ]; then
+                [ "$n" -gt "$SERIAL_MAX" ] && break
+                w=1
+            fi
+            if ! run $engine "$n" "$w"; then
+                echo "$engine n=$n workers=$w failed" >&2
+                status=1
+                continue
+            fi
+            TOTAL=$(awk -v c="$COMPUTE" -v o="$OUTPUT" \
+                'BEGIN { printf "%.6f", c + o }')
+
+            # first engine with a checksum is what everything else must match
+            if [ -z "$REF_COUNT" ] && [ "$CHECKSUM" != - ]; then
+                REF_COUNT=$COUNT
+                REF_SUM=$CHECKSUM
+            fi
+            if [ "$COUNT" = "$REF_COUNT" ] &&
+                { [ "$CHECKSUM" = - ] || [ "$CHECKSUM" = "$REF_SUM" ]; }; then
+                MATCH=yes
+            else
+                MATCH=no
+                status=1
+                echo "$engine n=$n workers=$w found different primes" >&2
+            fi
+
+            [ $engine = serial ] && SERIAL_T=$COMPUTE
+            if [ -z "$BASE_T" ]; then
+                BASE_T=$COMPUTE
+                BASE_W=$w
+            fi
+            VS_SERIAL=
+            [ -n "$SERIAL_T" ] && VS_SERIAL=$(ratio "$SERIAL_T" "$COMPUTE")
+            SPEEDUP=$(ratio "$BASE_T" "$COMPUTE")
+            EFFICIENCY=
+            [ -n "$SPEEDUP" ] &&
+                EFFICIENCY=$(ratio "$(awk -v s="$SPEEDUP" -v b="$BASE_W" \
+                    'BEGIN { print s * b }')" "$w")
+
+            ROW="$engine,$n,$w,$COMPUTE,$OUTPUT,$TOTAL,$COUNT,$CHECKSUM,$MATCH,$VS_SERIAL,$SPEEDUP,$EFFICIENCY"
+            echo "$ROW" >> "$OUT"
+            echo "$ROW"
+            [ $engine = serial ] && break
+        done
+    done
+done
+exit $status
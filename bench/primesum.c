@@ -0,0 +1,60 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// bytes read per fread
+#define READ_BUFFER 65536
+
+// splitmix64 finaliser, spreads consecutive primes over the whole range
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+int main(int argc, char* argv[]) {
+    // count and checksum of the numbers in every file, one per line
+    // checksum is a sum of hashes, so it doesn't depend on file or line
+    // order and per rank files can be checked without sorting
+    if (argc < 2) {
+        printf("Usage: %s file [file ...]\n", argv[0]);
+        return 1;
+    }
+    uint64_t count = 0, sum = 0;
+    static char buf[READ_BUFFER];
+
+    for (int i = 1; i < argc; ++i) {
+        FILE* f = fopen(argv[i], "r");
+        if (!f) {
+            printf("Couldn't open %s\n", argv[i]);
+            return 1;
+        }
+        uint64_t value = 0;
+        int digits = 0;
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), f)) > 0) {
+            for (size_t k = 0; k < len; ++k) {
+                char c = buf[k];
+                if (c >= '0' && c <= '9') {
+                    value = value * 10 + (uint64_t)(c - '0');
+                    digits = 1;
+                } else if (digits) {
+                    sum += mix(value);
+                    ++count;
+                    value = 0;
+                    digits = 0;
+                }
+            }
+        }
+        // last line without a newline
+        if (digits) {
+            sum += mix(value);
+            ++count;
+        }
+        fclose(f);
+    }
+    printf("%" PRIu64 " %016" PRIx64 "\n", count, sum);
+    return 0;
+}
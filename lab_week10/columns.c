@@ -0,0 +1,169 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ingest.h"
+
+// reads a file of rows through ingest, optionally writes it back out in
+// the binary columnar format, and times it against fscanf
+
+#define BLOCK_ROWS 65536
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static long scanf_rows(const char* path, int columns, double* sum) {
+    // the way task3 and task4 read their input, -1 if the file won't open
+    FILE* fp = fopen(path, "r");
+    if (!fp) return -1;
+    long count = 0, rows = 0;
+    char names[256];
+    float x;
+    *sum = 0;
+    if (fscanf(fp, "%ld ", &count) == 1) {
+        // a line of column names if it isn't a number
+        long at = ftell(fp);
+        if (fscanf(fp, "%f", &x) != 1 && fgets(names, sizeof(names), fp))
+            at = ftell(fp);
+        fseek(fp, at, SEEK_SET);
+        for (; rows < count; ++rows) {
+            int c = 0;
+            for (; c < columns && fscanf(fp, "%f", &x) == 1; ++c) *sum += x;
+            if (c < columns) break;
+        }
+    }
+    fclose(fp);
+    return rows;
+}
+
+static void discard(FILE* out, const char* path) {
+    // closes and deletes a half written copy, only if it's a plain file and
+    // not something like /dev/stdout
+    struct stat st;
+    int regular = !fstat(fileno(out), &st) && S_ISREG(st.st_mode);
+    fclose(out);
+    if (regular) remove(path);
+}
+
+int main(int argc, char* argv[]) {
+    // -c = numbers per row
+    // -j = parsing threads, default one per processor
+    // -s = time fscanf on the same file too
+    long columns = 1, threads = 0;
+    int scanf_too = 0, opt, failed = 0;
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "c:j:s")) != -1) {
+        switch (opt) {
+            case 'c':
+                columns = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || columns < 1 ||
+                         columns > INGEST_MAX_COLUMNS;
+                break;
+            case 'j':
+                threads = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || threads < 1;
+                break;
+            case 's':
+                scanf_too = 1;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    if (failed || argc - optind < 1 || argc - optind > 2) {
+        printf("Usage: %s [-c columns] [-j threads] [-s] in [out.col]\n",
+               argv[0]);
+        return 1;
+    }
+    const char* in_path = argv[optind];
+    const char* out_path = argc - optind == 2 ? argv[optind + 1] : NULL;
+
+    Ingest in;
+    double start = now();
+    int status = ingest_open(&in, in_path, (int)columns, (int)threads);
+    if (status) {
+        printf(status == 1 ? "Could not read %s\n"
+                           : "%s isn't a file of rows of numbers\n",
+               in_path);
+        return 1;
+    }
+    FILE* out = NULL;
+    IngestHeader header = {{0}, (uint32_t)columns, 0};
+    memcpy(header.magic, INGEST_MAGIC, 4);
+    if (out_path) {
+        out = fopen(out_path, "wb");
+        // the row count goes in once it's known
+        if (!out || fwrite(&header, sizeof(header), 1, out) != 1) {
+            printf("Could not write %s\n", out_path);
+            if (out) discard(out, out_path);
+            return 1;
+        }
+    }
+
+    IngestBatch batch;
+    long n, rows = 0;
+    double sum = 0;
+    int write_failed = 0;
+    while ((n = ingest_next(&in, BLOCK_ROWS, &batch)) > 0) {
+        for (int c = 0; c < columns; ++c)
+            for (long i = 0; i < n; ++i) sum += batch.cols[c][i];
+        if (out) {
+            uint64_t block = n;
+            write_failed |= fwrite(&block, sizeof(block), 1, out) != 1;
+            for (int c = 0; c < columns; ++c)
+                write_failed |=
+                    fwrite(batch.cols[c], sizeof(float), n, out) != (size_t)n;
+        }
+        rows += n;
+    }
+    double elapsed = now() - start;
+    if (n < 0) {
+        // no half written copy left behind for task4 to trip over
+        if (out) discard(out, out_path);
+        if (in.bad_line < 0)
+            printf("Could not read %s, short or out of memory\n", in_path);
+        else
+            printf("Line %ld of %s isn't %ld numbers\n", in.bad_line, in_path,
+                   columns);
+        return 1;
+    }
+    if (out) {
+        header.rows = rows;
+        write_failed |= fseek(out, 0, SEEK_SET) != 0;
+        write_failed |= fwrite(&header, sizeof(header), 1, out) != 1;
+        write_failed |= fflush(out) != 0;
+        if (write_failed) {
+            printf("Could not write %s\n", out_path);
+            discard(out, out_path);
+            return 1;
+        }
+        if (fclose(out)) {
+            printf("Could not write %s\n", out_path);
+            return 1;
+        }
+    }
+    printf("%s %s: %ld rows of %ld, checksum %.17g\n", in_path,
+           in.binary ? "binary" : "text", rows, columns, sum);
+    printf("Ingest time (s): %lf, %.1f MB/s\n", elapsed,
+           elapsed > 0 ? in.size / elapsed / 1e6 : 0.0);
+    size_t size = in.size;
+    int binary = in.binary;
+    ingest_close(&in);
+
+    if (scanf_too && !binary) {
+        start = now();
+        rows = scanf_rows(in_path, (int)columns, &sum);
+        elapsed = now() - start;
+        printf("fscanf: %ld rows, checksum %.17g\n", rows, sum);
+        printf("fscanf time (s): %lf, %.1f MB/s\n", elapsed,
+               elapsed > 0 ? size / elapsed / 1e6 : 0.0);
+    }
+    return 0;
+}
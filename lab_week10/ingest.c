@@ -0,0 +1,315 @@
+#include "ingest.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// pieces smaller than this aren't worth a thread
+#define INGEST_MIN_PIECE 65536
+
+// powers of 10 that are exact in a double
+static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                1e18, 1e19, 1e20, 1e21, 1e22};
+
+typedef struct {
+    const char* begin;  // whole lines
+    const char* end;
+    int columns;
+    long lines;  // line breaks in the piece
+    long room;   // rows it could have, lines plus one without a break
+    long offset;
+    float* cols[INGEST_MAX_COLUMNS];
+    long rows;
+    long bad_line;  // within the piece, -1 if it all parsed
+} IngestPiece;
+
+static int is_digit(char c) { return (unsigned)(c - '0') < 10; }
+
+static const char* skip_blank(const char* s, const char* end) {
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r')) ++s;
+    return s;
+}
+
+const char* ingest_parse_float(const char* s, const char* end, float* out) {
+    // [+-]digits[.digits][e[+-]digits] at s, past it or NULL if there's no
+    // number there, no locale so always a '.'
+    // up to 19 significant digits go into an integer, then one multiply or
+    // divide by an exact power of 10, which is what the inputs here need
+    int negative = 0, digits = 0, any = 0, exp10 = 0;
+    uint64_t mantissa = 0;
+    if (s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+    for (; s < end && is_digit(*s); ++s, any = 1) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += mantissa != 0;
+        } else {
+            ++exp10;
+        }
+    }
+    if (s < end && *s == '.')
+        for (++s; s < end && is_digit(*s); ++s, any = 1)
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += mantissa != 0;
+                --exp10;
+            }
+    if (!any) return NULL;
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        int exp_negative = 0, exponent = 0;
+        ++s;
+        if (s < end && (*s == '-' || *s == '+')) exp_negative = *s++ == '-';
+        if (s == end || !is_digit(*s)) return NULL;
+        for (; s < end && is_digit(*s); ++s)
+            if (exponent < 10000) exponent = exponent * 10 + (*s - '0');
+        exp10 += exp_negative ? -exponent : exponent;
+    }
+    double value = (double)mantissa;
+    if (value != 0) {
+        for (; exp10 > 22; exp10 -= 22) value *= powers[22];
+        for (; exp10 < -22; exp10 += 22) value /= powers[22];
+        value = exp10 < 0 ? value / powers[-exp10] : value * powers[exp10];
+    }
+    *out = (float)(negative ? -value : value);
+    return s;
+}
+
+static void* count_piece(void* arg) {
+    IngestPiece* p = (IngestPiece*)arg;
+    const char* s = p->begin;
+    p->lines = 0;
+    while (s < p->end && (s = memchr(s, '\n', p->end - s))) {
+        ++p->lines;
+        ++s;
+    }
+    p->room = p->lines + (p->end > p->begin && p->end[-1] != '\n');
+    return NULL;
+}
+
+static void* parse_piece(void* arg) {
+    // rows into cols, blank lines skipped
+    IngestPiece* p = (IngestPiece*)arg;
+    const char* s = p->begin;
+    long line = 0;
+    p->rows = 0;
+    p->bad_line = -1;
+    while (s < p->end) {
+        const char* t = skip_blank(s, p->end);
+        if (t < p->end && *t != '\n') {
+            for (int c = 0; c < p->columns && t; ++c)
+                t = ingest_parse_float(skip_blank(t, p->end), p->end,
+                                       &p->cols[c][p->rows]);
+            if (t) t = skip_blank(t, p->end);
+            if (!t || (t < p->end && *t != '\n')) {
+                p->bad_line = line;
+                return NULL;
+            }
+            ++p->rows;
+        }
+        s = t < p->end ? t + 1 : t;
+        ++line;
+    }
+    return NULL;
+}
+
+static void run_pieces(IngestPiece* pieces, int n, void* (*fn)(void*)) {
+    // piece 0 on the calling thread, the rest on their own
+    pthread_t tid[n];
+    int started[n];
+    for (int i = 1; i < n; ++i)
+        started[i] = !pthread_create(&tid[i], NULL, fn, &pieces[i]);
+    fn(&pieces[0]);
+    for (int i = 1; i < n; ++i)
+        if (started[i])
+            pthread_join(tid[i], NULL);
+        else
+            fn(&pieces[i]);
+}
+
+static int ingest_window(Ingest* in) {
+    // parses the next window of lines into in->parsed, 1 on a bad line or
+    // if out of memory
+    const char* start = in->next;
+    size_t left = in->end - start, want = in->threads * in->window;
+    const char* stop = left > want ? start + want : in->end;
+    if (stop < in->end) {
+        const char* nl = memchr(stop, '\n', in->end - stop);
+        stop = nl ? nl + 1 : in->end;
+    }
+    int n = (int)((stop - start) / INGEST_MIN_PIECE) + 1;
+    if (n > in->threads) n = in->threads;
+    IngestPiece pieces[n];
+    for (int i = 0; i < n; ++i) {
+        const char* b = i ? pieces[i - 1].end : start;
+        const char* e = start + (stop - start) * (i + 1) / n;
+        if (e < b) e = b;
+        if (i == n - 1) {
+            e = stop;
+        } else if (e < stop) {
+            const char* nl = memchr(e, '\n', stop - e);
+            e = nl ? nl + 1 : stop;
+        }
+        pieces[i].begin = b;
+        pieces[i].end = e;
+        pieces[i].columns = in->columns;
+    }
+    run_pieces(pieces, n, count_piece);
+
+    long room = 0;
+    for (int i = 0; i < n; ++i) {
+        pieces[i].offset = room;
+        room += pieces[i].room;
+    }
+    if (room > in->parsed_room) {
+        for (int c = 0; c < in->columns; ++c) {
+            float* col = (float*)realloc(in->parsed[c], room * sizeof(*col));
+            if (!col) return 1;
+            in->parsed[c] = col;
+        }
+        in->parsed_room = room;
+    }
+    for (int i = 0; i < n; ++i)
+        for (int c = 0; c < in->columns; ++c)
+            pieces[i].cols[c] = in->parsed[c] + pieces[i].offset;
+    run_pieces(pieces, n, parse_piece);
+
+    // close the gaps blank lines left, pieces are in file order
+    long rows = 0, line = in->line;
+    for (int i = 0; i < n; ++i) {
+        if (pieces[i].bad_line >= 0) {
+            in->bad_line = line + pieces[i].bad_line;
+            return 1;
+        }
+        if (rows != pieces[i].offset)
+            for (int c = 0; c < in->columns; ++c)
+                memmove(in->parsed[c] + rows, pieces[i].cols[c],
+                        pieces[i].rows * sizeof(float));
+        rows += pieces[i].rows;
+        line += pieces[i].lines;
+    }
+    for (int c = 0; c < in->columns; ++c) in->block[c] = in->parsed[c];
+    in->block_rows = rows;
+    in->served = 0;
+    in->next = stop;
+    in->line = line;
+    return 0;
+}
+
+static int ingest_block(Ingest* in) {
+    // the next block of a binary file, its columns used where they are
+    uint64_t rows;
+    in->served = in->block_rows = 0;
+    if ((size_t)(in->end - in->next) < sizeof(rows)) {
+        in->next = in->end;
+        return 0;
+    }
+    memcpy(&rows, in->next, sizeof(rows));
+    size_t bytes = rows * in->columns * sizeof(float);
+    if (rows > in->size || bytes > (size_t)(in->end - in->next) - sizeof(rows))
+        return 1;
+    const float* cols = (const float*)(in->next + sizeof(rows));
+    for (int c = 0; c < in->columns; ++c) in->block[c] = cols + c * rows;
+    in->block_rows = (long)rows;
+    in->next += sizeof(rows) + bytes;
+    return 0;
+}
+
+int ingest_open(Ingest* in, const char* path, int columns, int threads) {
+    // threads < 1 for one per processor, 0 once open, 1 if the file can't
+    // be read, 2 if it doesn't have columns numbers per row
+    memset(in, 0, sizeof(*in));
+    in->path = path;
+    in->columns = columns;
+    in->bad_line = -1;
+    if (columns < 1 || columns > INGEST_MAX_COLUMNS) return 2;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0) return 1;
+    if (fstat(fd, &st)) {
+        close(fd);
+        return 1;
+    }
+    in->size = st.st_size;
+    if (in->size) {
+        void* map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return 1;
+        }
+        posix_madvise(map, in->size, POSIX_MADV_SEQUENTIAL);
+        in->data = (const char*)map;
+    }
+    close(fd);
+    in->end = in->data + in->size;
+
+    if (in->size >= sizeof(IngestHeader) &&
+        !memcmp(in->data, INGEST_MAGIC, 4)) {
+        IngestHeader header;
+        memcpy(&header, in->data, sizeof(header));
+        in->binary = 1;
+        in->rows = (long)header.rows;
+        in->next = in->data + sizeof(header);
+        if (header.columns != (uint32_t)columns) {
+            ingest_close(in);
+            return 2;
+        }
+        return 0;
+    }
+
+    // row count, then column names if the next line starts with a letter
+    const char* s = skip_blank(in->data, in->end);
+    if (s == in->end || !is_digit(*s)) {
+        ingest_close(in);
+        return 2;
+    }
+    for (; s < in->end && is_digit(*s); ++s)
+        in->rows = in->rows * 10 + (*s - '0');
+    s = skip_blank(s, in->end);
+    if (s < in->end && *s++ != '\n') {
+        ingest_close(in);
+        return 2;
+    }
+    in->line = 2;
+    const char* t = skip_blank(s, in->end);
+    if (t < in->end && ((*t | 32) >= 'a' && (*t | 32) <= 'z')) {
+        t = memchr(t, '\n', in->end - t);
+        s = t ? t + 1 : in->end;
+        ++in->line;
+    }
+    in->next = s;
+    if (threads < 1) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    in->threads = threads < 1 ? 1 : threads;
+    in->window = 4 << 20;
+    return 0;
+}
+
+long ingest_next(Ingest* in, long max, IngestBatch* batch) {
+    // up to max rows, 0 once the file or the row count runs out, -1 on a
+    // line that isn't columns numbers (line number in bad_line), a binary
+    // file that's been cut short or out of memory (bad_line -1 for both)
+    while (in->served == in->block_rows) {
+        if (in->delivered >= in->rows || in->next >= in->end) return 0;
+        if (in->binary ? ingest_block(in) : ingest_window(in)) return -1;
+    }
+    long n = in->block_rows - in->served;
+    if (n > max) n = max;
+    if (n > in->rows - in->delivered) n = in->rows - in->delivered;
+    if (n <= 0) return 0;
+    for (int c = 0; c < in->columns; ++c)
+        batch->cols[c] = in->block[c] + in->served;
+    batch->rows = n;
+    in->served += n;
+    in->delivered += n;
+    return n;
+}
+
+void ingest_close(Ingest* in) {
+    if (in->data) munmap((void*)in->data, in->size);
+    for (int c = 0; c < INGEST_MAX_COLUMNS; ++c) free(in->parsed[c]);
+    memset(in, 0, sizeof(*in));
+}
@@ -0,0 +1,58 @@
+#ifndef INGEST_H_INCLUDED
+#define INGEST_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define INGEST_MAX_COLUMNS 8
+
+// binary columnar files start "QCOL", then the column count and the row
+// count, then blocks of a row count and each column's floats in turn
+#define INGEST_MAGIC "QCOL"
+
+typedef struct {
+    char magic[4];
+    uint32_t columns;
+    uint64_t rows;
+} IngestHeader;
+
+// up to max rows, a column at a time, valid until the next ingest_next
+typedef struct {
+    long rows;
+    const float* cols[INGEST_MAX_COLUMNS];
+} IngestBatch;
+
+// text files are a row count on the first line, optionally a line of
+// column names, then a row per line, the file is mapped rather than read
+// and parsed a window at a time, the window split between threads at
+// line breaks
+typedef struct {
+    const char* path;
+    const char* data;
+    size_t size;
+    int binary;
+    int columns;
+    long rows;  // the file says it has, never more are handed out
+    long delivered;
+    const char* next;  // not parsed yet, or the next block
+    const char* end;
+    long line;  // of next, for errors
+    // text only
+    int threads;
+    size_t window;  // bytes per thread per window
+    float* parsed[INGEST_MAX_COLUMNS];
+    long parsed_rows;
+    long parsed_room;
+    // rows of the window or block handed out already
+    long served;
+    long block_rows;
+    const float* block[INGEST_MAX_COLUMNS];
+    long bad_line;  // where a parse failed, for the error
+} Ingest;
+
+int ingest_open(Ingest*, const char*, int, int);
+long ingest_next(Ingest*, long, IngestBatch*);
+void ingest_close(Ingest*);
+const char* ingest_parse_float(const char*, const char*, float*);
+
+#endif
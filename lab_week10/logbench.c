@@ -0,0 +1,136 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logship.h"
+
+#define LINE_TAG 0
+
+// lines per second through the master, every slave logging flat out
+// either a message per line like task1/task2 used to, or shipped in frames
+
+static void write_line(int source, int kind, const char* text, size_t len,
+                       void* arg) {
+    if (kind != LOGSHIP_EOF) fwrite(text, 1, len, (FILE*)arg);
+}
+
+int main(int argc, char* argv[]) {
+    int rank, size;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const int master = 0;
+
+    // -n = lines per slave
+    // -p = a message and a flush per line instead of frames
+    // -f = frame size in bytes
+    // -d = longest a line waits in a frame, seconds
+    // -o = file the master writes the lines to, default /dev/null
+    long lines = 100000, frame = LOGSHIP_FRAME_SIZE;
+    double delay = LOGSHIP_DELAY;
+    int per_line = 0, opt, failed = 0;
+    const char* path = "/dev/null";
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "n:pf:d:o:")) != -1) {
+        switch (opt) {
+            case 'n':
+                lines = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || lines < 0;
+                break;
+            case 'p':
+                per_line = 1;
+                break;
+            case 'f':
+                frame = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || frame < 1;
+                break;
+            case 'd':
+                delay = strtod(optarg, &ptr);
+                failed = ptr == optarg;
+                break;
+            case 'o':
+                path = optarg;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    if (failed || optind != argc || size < 2) {
+        if (rank == master)
+            printf("Usage: %s [-n lines] [-p] [-f frame] [-d delay] "
+                   "[-o file], at least 2 processes\n",
+                   argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    if (rank == master) {
+        FILE* out = fopen(path, "w");
+        if (!out) {
+            printf("Could not open %s\n", path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        long received = 0;
+        if (per_line) {
+            char buf[256];
+            MPI_Status status;
+            for (received = 0; received < lines * (size - 1); ++received) {
+                MPI_Recv(buf, 256, MPI_CHAR, MPI_ANY_SOURCE, LINE_TAG,
+                         MPI_COMM_WORLD, &status);
+                fputs(buf, out);
+                fflush(out);
+            }
+        } else {
+            LogCollector lc;
+            if (logship_collector_init(&lc, MPI_COMM_WORLD, size - 1)) {
+                printf("Could not malloc\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            setvbuf(out, NULL, _IOFBF, 1 << 16);
+            while (lc.open) {
+                if (logship_collect(&lc, write_line, out)) {
+                    printf("Could not malloc\n");
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+                if (!logship_pending(&lc)) fflush(out);
+            }
+            received = lc.lines;
+            printf("Frames: %ld\n", lc.frames);
+            logship_collector_free(&lc);
+        }
+        fclose(out);
+        double elapsed = MPI_Wtime() - start;
+        printf("Lines: %ld from %d slaves, %s\n", received, size - 1,
+               per_line ? "a message per line" : "shipped in frames");
+        printf("Overall time (s): %lf\n", elapsed);
+        printf("Lines per second: %.3e\n",
+               elapsed > 0 ? received / elapsed : 0.0);
+    } else if (per_line) {
+        char buf[256];
+        for (long i = 0; i < lines; ++i) {
+            sprintf(buf, "Slave %d line %ld\n", rank, i);
+            MPI_Send(buf, strlen(buf) + 1, MPI_CHAR, master, LINE_TAG,
+                     MPI_COMM_WORLD);
+        }
+    } else {
+        LogShipper log;
+        if (logship_open(&log, MPI_COMM_WORLD, master, frame, delay)) {
+            printf("Could not malloc\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        for (long i = 0; i < lines; ++i) {
+            if (logship_printf(&log, 0, "Slave %d line %ld\n", rank, i)) {
+                printf("Could not malloc\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        logship_close(&log);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
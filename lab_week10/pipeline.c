@@ -0,0 +1,572 @@
+#include "pipeline.h"
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a run of stages one rank does back to back, on replicas ranks in a row
+typedef struct {
+    int first;
+    int last;
+    int rank0;
+    int replicas;
+} PipeGroup;
+
+// a group of one the source keeps within window batches of
+typedef struct {
+    int rank;
+    long window;
+    long seq;  // the batch it's waiting for as of its last report
+} PipeWatch;
+
+// a batch that came in ahead of its turn
+typedef struct {
+    PipeHeader header;
+    char* data;
+    int from;  // upstream rank owed a credit once it's used, -1 if none
+} PipeParked;
+
+typedef struct {
+    MPI_Comm comm;
+    int depth;
+    PipeStats* stats;
+    // from the group before, NULL for the source
+    const PipeGroup* up;
+    int nin;  // receives posted, depth per upstream rank
+    char** in;
+    MPI_Request* in_req;
+    size_t in_bytes;  // per item
+    int in_next;
+    int* unacked;  // per upstream rank, batches finished but not credited
+    int ended;     // upstream ranks that have ended their stream
+    int ordered;
+    long next_seq;
+    int from_slot;  // 1 + slot of the batch being worked on, 0 if parked
+    PipeParked* parked;
+    int nparked;
+    int parked_room;
+    PipeParked current;
+    // on a group of one fed out of order, how far ahead the source can
+    // get and where to tell it how far this rank has got, 0 and -1 if not
+    long window;
+    int source;
+    // on the source, the groups it waits on
+    PipeWatch* watch;
+    int nwatch;
+    // to the group after, NULL for the sink
+    const PipeGroup* down;
+    int nout;
+    char** out;
+    MPI_Request* out_req;
+    size_t out_bytes;
+    int out_next;
+    int* credits;  // per downstream rank
+    int dest;      // downstream rank the batch being made goes to
+    int turn;
+} Pipe;
+
+static char** pipe_buffers(int count, size_t bytes) {
+    // count buffers of bytes each
+    char** bufs = (char**)malloc(count * sizeof(*bufs));
+    if (!bufs) return NULL;
+    for (int i = 0; i < count; ++i) {
+        bufs[i] = (char*)malloc(bytes ? bytes : 1);
+        if (!bufs[i]) {
+            while (i--) free(bufs[i]);
+            free(bufs);
+            return NULL;
+        }
+    }
+    return bufs;
+}
+
+static void pipe_free_buffers(char** bufs, int count) {
+    if (!bufs) return;
+    for (int i = 0; i < count; ++i) free(bufs[i]);
+    free(bufs);
+}
+
+int pipe_parse_replicas(const char* list, int nstages, int* replicas) {
+    // comma separated ranks per stage, 1 unless it's nstages numbers >= 1
+    const char* at = list;
+    char* ptr;
+    for (int s = 0; s < nstages; ++s) {
+        replicas[s] = (int)strtol(at, &ptr, 10);
+        if (ptr == at || replicas[s] < 1) return 1;
+        if (s < nstages - 1 && *ptr++ != ',') return 1;
+        at = ptr;
+    }
+    return *at != '\0';
+}
+
+static int pipe_layout(int size, const PipeStage* stages, int nstages,
+                       const int* replicas, PipeGroup* groups) {
+    // fills groups in, returns how many, 0 if the replicas don't fit
+    // stages run one per group when there are enough ranks, otherwise a
+    // few to a rank
+    if (size < nstages) {
+        if (replicas) return 0;
+        for (int g = 0; g < size; ++g) {
+            groups[g].first = (int)((long)g * nstages / size);
+            groups[g].last = (int)((long)(g + 1) * nstages / size);
+            groups[g].rank0 = g;
+            groups[g].replicas = 1;
+        }
+        return size;
+    }
+    int used = 0, spread = 0;
+    for (int s = 0; s < nstages; ++s) {
+        int serial = stages[s].serial || s == 0 || s == nstages - 1;
+        groups[s].first = s;
+        groups[s].last = s + 1;
+        groups[s].replicas = replicas ? replicas[s] : 1;
+        if (serial && groups[s].replicas > 1) return 0;
+        spread += !serial;
+        used += groups[s].replicas;
+    }
+    if (used > size) return 0;
+    // spare ranks go round the stages that can take them
+    for (int s = 0; !replicas && spread && used < size; s = (s + 1) % nstages)
+        if (!(stages[s].serial || s == 0 || s == nstages - 1)) {
+            ++groups[s].replicas;
+            ++used;
+        }
+    for (int s = 0, rank = 0; s < nstages; rank += groups[s++].replicas)
+        groups[s].rank0 = rank;
+    return nstages;
+}
+
+static void pipe_post(Pipe* p, int slot, long batch) {
+    // any rank of the group before, receives posted for the same sources
+    // are matched in the order they were posted, so slots fill in turn
+    MPI_Irecv(p->in[slot], (int)(sizeof(PipeHeader) + batch * p->in_bytes),
+              MPI_BYTE, MPI_ANY_SOURCE, PIPE_DATA_TAG, p->comm,
+              &p->in_req[slot]);
+}
+
+static void pipe_credit(Pipe* p, int from, int flush) {
+    // upstream gets its credit back in lumps of half the depth to halve
+    // the credit messages, or whatever it's owed once the stream is done
+    int* owed = &p->unacked[from];
+    if (*owed && (flush || *owed >= (p->depth + 1) / 2)) {
+        MPI_Send(owed, 1, MPI_INT, p->up->rank0 + from, PIPE_CREDIT_TAG,
+                 p->comm);
+        *owed = 0;
+    }
+}
+
+static void pipe_park(Pipe* p, int from, const PipeHeader* header,
+                      const char* data) {
+    if (p->nparked == p->parked_room) {
+        p->parked_room = p->parked_room ? 2 * p->parked_room : 8;
+        p->parked = (PipeParked*)realloc(
+            p->parked, p->parked_room * sizeof(*p->parked));
+        if (!p->parked) {
+            printf("Could not malloc\n");
+            MPI_Abort(p->comm, 1);
+        }
+    }
+    PipeParked* held = &p->parked[p->nparked++];
+    held->header = *header;
+    held->from = from;
+    held->data = (char*)malloc(header->count * p->in_bytes + 1);
+    if (!held->data) {
+        printf("Could not malloc\n");
+        MPI_Abort(p->comm, 1);
+    }
+    memcpy(held->data, data, header->count * p->in_bytes);
+    if (p->nparked > p->stats->max_parked) p->stats->max_parked = p->nparked;
+}
+
+static int pipe_fed_in_order(const PipeGroup* groups, int g) {
+    // whether group g gets its batches in sequence order, true unless the
+    // group before is spread over several ranks and gets its own batches
+    // from several, then one rank of it can get well ahead of another
+    return g < 2 || groups[g - 1].replicas == 1 || groups[g - 2].replicas == 1;
+}
+
+static long pipe_window(const PipeGroup* groups, int g, int depth) {
+    // how many batches the source can get ahead of group g, 0 for no limit
+    // a group of one fed in order never parks more than depth per rank
+    // before it, as their credit waits until the parked batches are used,
+    // fed out of order holding credit back could leave the batch it wants
+    // stuck behind ones it has parked, so the source stays within twice
+    // that many batches of it instead, reporting every half window
+    if (groups[g].replicas > 1 || pipe_fed_in_order(groups, g)) return 0;
+    return 2L * depth * groups[g - 1].replicas;
+}
+
+static void pipe_hear(Pipe* p) {
+    // a report from one of the groups the source waits on
+    long seq;
+    MPI_Status status;
+    MPI_Recv(&seq, 1, MPI_LONG, MPI_ANY_SOURCE, PIPE_WINDOW_TAG, p->comm,
+             &status);
+    for (int i = 0; i < p->nwatch; ++i)
+        if (p->watch[i].rank == status.MPI_SOURCE) p->watch[i].seq = seq;
+}
+
+static void pipe_wait_window(Pipe* p, long seq) {
+    // the source holds batch seq back until it's in every window
+    double t = MPI_Wtime();
+    for (int i = 0; i < p->nwatch; ++i)
+        while (seq >= p->watch[i].seq + p->watch[i].window) pipe_hear(p);
+    p->stats->wait_time += MPI_Wtime() - t;
+}
+
+static int pipe_unpark(Pipe* p) {
+    // the next batch in order if it came in early, into p->current
+    for (int i = 0; i < p->nparked; ++i)
+        if (p->parked[i].header.seq == p->next_seq) {
+            p->current = p->parked[i];
+            p->parked[i] = p->parked[--p->nparked];
+            p->from_slot = 0;
+            if (p->current.from >= 0) ++p->unacked[p->current.from];
+            return 1;
+        }
+    return 0;
+}
+
+static long pipe_next_in(Pipe* p, const char** in, long batch) {
+    // waits for the next batch from upstream, in sequence order on a
+    // group of one, -1 once every upstream rank has ended its stream
+    // batches that are ahead are copied out so their slot goes straight
+    // back, holding slots could starve the batch being waited on, their
+    // credit waits until they're used when the batches come in order, so
+    // no rank gets more than depth batches ahead, otherwise the source
+    // keeps within the window and the credit goes back straight away
+    double t = MPI_Wtime();
+    while (!(p->ordered && pipe_unpark(p))) {
+        if (p->ended == p->up->replicas) {
+            p->stats->wait_time += MPI_Wtime() - t;
+            return -1;
+        }
+        MPI_Status status;
+        int slot = p->in_next;
+        MPI_Wait(&p->in_req[slot], &status);
+        p->in_next = (slot + 1) % p->nin;
+        int from = status.MPI_SOURCE - p->up->rank0;
+        PipeHeader header;
+        memcpy(&header, p->in[slot], sizeof(header));
+        char* data = p->in[slot] + sizeof(header);
+        if (header.count < 0) {
+            ++p->ended;
+            pipe_post(p, slot, batch);
+            continue;
+        }
+        if (!p->ordered || header.seq == p->next_seq) {
+            p->current.header = header;
+            p->current.data = data;
+            p->from_slot = slot + 1;
+            ++p->unacked[from];
+            break;
+        }
+        pipe_park(p, p->window ? -1 : from, &header, data);
+        pipe_post(p, slot, batch);
+        if (p->window) {
+            ++p->unacked[from];
+            pipe_credit(p, from, 0);
+        }
+    }
+    p->stats->wait_time += MPI_Wtime() - t;
+    ++p->stats->batches;
+    ++p->next_seq;
+    // the source hears how far this rank has got every half window
+    if (p->window && p->next_seq % ((p->window + 1) / 2) == 0)
+        MPI_Send(&p->next_seq, 1, MPI_LONG, p->source, PIPE_WINDOW_TAG,
+                 p->comm);
+    *in = p->current.data;
+    return p->current.header.count;
+}
+
+static void pipe_done_in(Pipe* p, long batch) {
+    // finished with the current batch, its slot is posted again or its
+    // copy freed, and its sender owed a credit
+    if (p->from_slot)
+        pipe_post(p, p->from_slot - 1, batch);
+    else
+        free(p->current.data);
+    for (int i = 0; i < p->up->replicas; ++i) pipe_credit(p, i, 0);
+}
+
+static void pipe_take_credit(Pipe* p, int blocking) {
+    // collect credit from downstream, waiting for some if blocking
+    int credit, flag = blocking;
+    MPI_Status status;
+    if (!blocking)
+        MPI_Iprobe(MPI_ANY_SOURCE, PIPE_CREDIT_TAG, p->comm, &flag, &status);
+    while (flag) {
+        MPI_Recv(&credit, 1, MPI_INT, MPI_ANY_SOURCE, PIPE_CREDIT_TAG, p->comm,
+                 &status);
+        p->credits[status.MPI_SOURCE - p->down->rank0] += credit;
+        MPI_Iprobe(MPI_ANY_SOURCE, PIPE_CREDIT_TAG, p->comm, &flag, &status);
+    }
+}
+
+static char* pipe_next_out(Pipe* p) {
+    // buffer for the next batch, bound for the downstream rank with the
+    // most room for it, ties taken in turn
+    double t = MPI_Wtime();
+    pipe_take_credit(p, 0);
+    for (;;) {
+        int best = -1;
+        for (int i = 0; i < p->down->replicas; ++i) {
+            int d = (p->turn + i) % p->down->replicas;
+            if (p->credits[d] && (best < 0 || p->credits[d] > p->credits[best]))
+                best = d;
+        }
+        if (best >= 0) {
+            p->dest = best;
+            break;
+        }
+        pipe_take_credit(p, 1);
+    }
+    MPI_Wait(&p->out_req[p->out_next], MPI_STATUS_IGNORE);
+    p->stats->wait_time += MPI_Wtime() - t;
+    return p->out[p->out_next] + sizeof(PipeHeader);
+}
+
+static void pipe_send_out(Pipe* p, long seq, long n) {
+    PipeHeader header = {seq, n};
+    memcpy(p->out[p->out_next], &header, sizeof(header));
+    MPI_Isend(p->out[p->out_next], (int)(sizeof(header) + n * p->out_bytes),
+              MPI_BYTE, p->down->rank0 + p->dest, PIPE_DATA_TAG, p->comm,
+              &p->out_req[p->out_next]);
+    p->out_next = (p->out_next + 1) % p->nout;
+    --p->credits[p->dest];
+    p->turn = (p->dest + 1) % p->down->replicas;
+}
+
+int pipe_run(MPI_Comm comm, const PipeStage* stages, int nstages,
+             const PipeOptions* opts, PipeStats* stats) {
+    // lays the stages out over the ranks and runs them, ranks left over
+    // once every stage has what it asked for have nothing to do
+    // collective, 1 if the replicas don't fit, 2 if a stage's open failed
+    // on any rank
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    double start = MPI_Wtime();
+    long batch = opts->batch;
+    memset(stats, 0, sizeof(*stats));
+    stats->first = stats->last = -1;
+    PipeGroup* groups = (PipeGroup*)malloc(nstages * sizeof(*groups));
+    if (!groups) {
+        printf("Could not malloc\n");
+        MPI_Abort(comm, 1);
+    }
+    int ngroups = pipe_layout(size, stages, nstages, opts->replicas, groups);
+    if (!ngroups) {
+        free(groups);
+        return 1;
+    }
+    const PipeGroup* mine = NULL;
+    int g = 0;
+    for (; g < ngroups && !mine; ++g)
+        if (rank >= groups[g].rank0 &&
+            rank < groups[g].rank0 + groups[g].replicas)
+            mine = &groups[g];
+    if (mine) {
+        stats->first = mine->first;
+        stats->last = mine->last;
+        stats->replica = rank - mine->rank0;
+        stats->replicas = mine->replicas;
+    }
+    int first = stats->first, last = stats->last;
+
+    int failed = 0, opened = first;
+    for (; opened < last && !failed; ++opened)
+        if (stages[opened].open) failed = stages[opened].open(stages[opened].arg);
+    if (failed) --opened;
+    MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_LOR, comm);
+    if (failed || !mine) {
+        for (int s = first; s < opened; ++s)
+            if (stages[s].close) stages[s].close(stages[s].arg);
+        free(groups);
+        stats->elapsed = MPI_Wtime() - start;
+        return failed ? 2 : 0;
+    }
+
+    // g is now one past this rank's group
+    Pipe p = {.comm = comm, .depth = opts->depth, .stats = stats};
+    p.up = first > 0 ? &groups[g - 2] : NULL;
+    p.down = last < nstages ? &groups[g] : NULL;
+    p.ordered = mine->replicas == 1;
+    p.window = pipe_window(groups, g - 1, p.depth);
+    p.source = groups[0].rank0;
+    // batches between stages on this rank go through these two in turn
+    size_t scratch_bytes = 0;
+    for (int s = first; s < last - 1; ++s)
+        if (stages[s].out_size > scratch_bytes)
+            scratch_bytes = stages[s].out_size;
+    char** scratch = pipe_buffers(2, batch * scratch_bytes);
+    int ok = scratch != NULL;
+    if (!p.up) {
+        p.watch = (PipeWatch*)malloc(ngroups * sizeof(*p.watch));
+        ok = ok && p.watch;
+        for (int w = 0; ok && w < ngroups; ++w) {
+            PipeWatch watch = {groups[w].rank0,
+                               pipe_window(groups, w, p.depth), 0};
+            if (watch.window) p.watch[p.nwatch++] = watch;
+        }
+    }
+    if (p.up) {
+        p.nin = p.depth * p.up->replicas;
+        p.in_bytes = stages[first - 1].out_size;
+        p.in = pipe_buffers(p.nin, sizeof(PipeHeader) + batch * p.in_bytes);
+        p.in_req = (MPI_Request*)malloc(p.nin * sizeof(*p.in_req));
+        p.unacked = (int*)calloc(p.up->replicas, sizeof(*p.unacked));
+        ok = ok && p.in && p.in_req && p.unacked;
+        if (p.ordered && p.up->replicas > 1)
+            stats->park_limit = p.window ? p.window - 1
+                                         : (long)p.depth * p.up->replicas;
+    }
+    if (p.down) {
+        p.nout = p.depth * p.down->replicas;
+        p.out_bytes = stages[last - 1].out_size;
+        p.out = pipe_buffers(p.nout, sizeof(PipeHeader) + batch * p.out_bytes);
+        p.out_req = (MPI_Request*)malloc(p.nout * sizeof(*p.out_req));
+        p.credits = (int*)malloc(p.down->replicas * sizeof(*p.credits));
+        ok = ok && p.out && p.out_req && p.credits;
+    }
+    if (!ok) {
+        printf("Could not malloc\n");
+        MPI_Abort(comm, 1);
+    }
+    for (int i = 0; i < p.nin; ++i) pipe_post(&p, i, batch);
+    for (int i = 0; i < p.nout; ++i) p.out_req[i] = MPI_REQUEST_NULL;
+    for (int i = 0; p.down && i < p.down->replicas; ++i)
+        p.credits[i] = p.depth;
+
+    for (long seq = 0, done = 0; !done; ++seq) {
+        const char* in = NULL;
+        long n = batch;
+        if (p.up) {
+            if ((n = pipe_next_in(&p, &in, batch)) < 0) break;
+            seq = p.current.header.seq;
+            stats->items += n;
+        }
+        char* out = NULL;
+        for (int s = first; s < last; ++s) {
+            if (s == last - 1 && p.down) {
+                if (p.nwatch) pipe_wait_window(&p, seq);
+                out = pipe_next_out(&p);
+            }
+            else if (s < last - 1)
+                out = scratch[(s - first) % 2];
+            double t = MPI_Wtime();
+            // a stage that made nothing still hands on an empty batch, a
+            // later group of one would wait for its number otherwise
+            long made = n > 0 || s == 0 ? stages[s].fn(in, n, out,
+                                                        stages[s].arg)
+                                        : 0;
+            stats->busy_time += MPI_Wtime() - t;
+            if (s == first && p.up) pipe_done_in(&p, batch);
+            in = out;
+            n = made;
+            if (s == 0) {
+                // the source is out of items
+                stats->items += made;
+                stats->batches += made > 0;
+                if ((done = !made)) break;
+            }
+        }
+        if (p.down && !done) pipe_send_out(&p, seq, n);
+    }
+
+    if (p.down) {
+        // everything sent then the end of the stream to every rank after,
+        // and all the credit back so no message is left behind
+        PipeHeader end = {-1, -1};
+        MPI_Waitall(p.nout, p.out_req, MPI_STATUSES_IGNORE);
+        for (int i = 0; i < p.down->replicas; ++i)
+            MPI_Send(&end, sizeof(end), MPI_BYTE, p.down->rank0 + i,
+                     PIPE_DATA_TAG, comm);
+        for (int i = 0; i < p.down->replicas; ++i)
+            while (p.credits[i] < p.depth) pipe_take_credit(&p, 1);
+        // and every report the groups it waits on will send, the last
+        // comes at the last whole half window
+        for (int i = 0; i < p.nwatch; ++i) {
+            long step = (p.watch[i].window + 1) / 2;
+            while (p.watch[i].seq < stats->batches / step * step) pipe_hear(&p);
+        }
+    }
+    if (p.up) {
+        for (int i = 0; i < p.up->replicas; ++i) pipe_credit(&p, i, 1);
+        // every slot was posted again after use, none will be matched now
+        for (int i = 0; i < p.nin; ++i) {
+            MPI_Cancel(&p.in_req[i]);
+            MPI_Wait(&p.in_req[i], MPI_STATUS_IGNORE);
+        }
+    }
+    for (int s = first; s < last; ++s)
+        if (stages[s].close) stages[s].close(stages[s].arg);
+
+    pipe_free_buffers(scratch, 2);
+    pipe_free_buffers(p.in, p.nin);
+    pipe_free_buffers(p.out, p.nout);
+    free(p.in_req);
+    free(p.out_req);
+    free(p.unacked);
+    free(p.credits);
+    free(p.parked);
+    free(p.watch);
+    free(groups);
+    stats->elapsed = MPI_Wtime() - start;
+    return 0;
+}
+
+void pipe_report(MPI_Comm comm, int root, const PipeStage* stages,
+                 const PipeStats* stats) {
+    // what each rank ran and where its time went, the stage with the most
+    // busy time per rank is what limits the throughput
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    double mine[7] = {stats->first,     stats->last,      stats->replica,
+                      stats->replicas,  stats->busy_time, stats->wait_time,
+                      stats->elapsed};
+    long counts[4] = {stats->items, stats->batches, stats->max_parked,
+                      stats->park_limit};
+    double* all = NULL;
+    long* all_counts = NULL;
+    if (rank == root) {
+        all = (double*)malloc(7 * size * sizeof(*all));
+        all_counts = (long*)malloc(4 * size * sizeof(*all_counts));
+        if (!all || !all_counts) {
+            printf("Could not malloc\n");
+            MPI_Abort(comm, 1);
+        }
+    }
+    MPI_Gather(mine, 7, MPI_DOUBLE, all, 7, MPI_DOUBLE, root, comm);
+    MPI_Gather(counts, 4, MPI_LONG, all_counts, 4, MPI_LONG, root, comm);
+
+    if (rank == root) {
+        double elapsed = 0;
+        long items = 0;
+        for (int i = 0; i < size; ++i) {
+            const double* r = all + 7 * i;
+            const long* c = all_counts + 4 * i;
+            if (r[0] < 0) {
+                printf("Rank %d: spare\n", i);
+                continue;
+            }
+            printf("Rank %d:", i);
+            for (int s = (int)r[0]; s < (int)r[1]; ++s)
+                printf("%s%s", s == (int)r[0] ? " " : "+", stages[s].name);
+            if (r[3] > 1) printf(" %d/%d", (int)r[2] + 1, (int)r[3]);
+            printf(", %ld items in %ld batches, busy %.3f s, waiting %.3f s",
+                   c[0], c[1], r[4], r[5]);
+            if (c[2]) printf(", up to %ld of %ld held back", c[2], c[3]);
+            printf("\n");
+            if (r[6] > elapsed) elapsed = r[6];
+            if (r[0] == 0) items = c[0];
+        }
+        printf("Pipeline time (s): %lf\n", elapsed);
+        printf("Items per second: %.3e\n", elapsed > 0 ? items / elapsed : 0.0);
+        fflush(stdout);
+        free(all);
+        free(all_counts);
+    }
+}
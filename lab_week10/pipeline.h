@@ -0,0 +1,71 @@
+#ifndef PIPELINE_H_INCLUDED
+#define PIPELINE_H_INCLUDED
+
+#include <mpi.h>
+#include <stddef.h>
+
+#define PIPE_DATA_TAG 400
+#define PIPE_CREDIT_TAG 401
+#define PIPE_WINDOW_TAG 402
+
+// a stage gets a batch of n items and writes at most a batch of items for
+// the next stage to out, returning how many
+// the first stage is the source, it gets no input, n is how many items
+// fit and it returns 0 once there are no more
+// the last stage is the sink, out is NULL and what it returns is ignored
+typedef long (*PipeStageFn)(const void*, long, void*, void*);
+
+typedef struct {
+    const char* name;
+    PipeStageFn fn;
+    size_t out_size;  // bytes per item handed on, unused for the sink
+    void* arg;
+    // both optional, called on the rank running the stage before the
+    // first batch and after the last, open returns nonzero to give up
+    int (*open)(void*);
+    void (*close)(void*);
+    // keeps state from batch to batch so only ever gets one rank, the
+    // source and the sink always do
+    int serial;
+} PipeStage;
+
+// every batch carries its number from the source, a stage on one rank
+// gets them in that order whatever ran before it
+typedef struct {
+    long seq;
+    long count;  // items, -1 to end the stream
+} PipeHeader;
+
+// batches go from each rank of a stage to each rank of the next depth at
+// a time, the receiver has a receive posted for each and hands back a
+// credit as it finishes them, the sender passes each batch to the rank
+// with the most credit and waits when none has any, so a slow rank gets
+// fewer batches and messages can't pile up unreceived
+typedef struct {
+    long batch;  // items per message
+    int depth;   // batches in flight per link, 2 is double buffering
+    // ranks per stage, NULL shares the ranks left over from one each out
+    // between the stages that aren't serial
+    const int* replicas;
+} PipeOptions;
+
+typedef struct {
+    // stages run on this rank, [first, last), both -1 on a spare rank
+    int first;
+    int last;
+    int replica;  // which of the stage's ranks this is
+    int replicas;
+    long items;  // into the rank, out of it for the source
+    long batches;
+    double busy_time;  // in stage functions
+    double wait_time;  // for input or credit
+    double elapsed;
+    long max_parked;  // batches held back to put them in order
+    long park_limit;  // most that can be
+} PipeStats;
+
+int pipe_parse_replicas(const char*, int, int*);
+int pipe_run(MPI_Comm, const PipeStage*, int, const PipeOptions*, PipeStats*);
+void pipe_report(MPI_Comm, int, const PipeStage*, const PipeStats*);
+
+#endif
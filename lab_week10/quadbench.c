@@ -0,0 +1,148 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "quadsolve.h"
+
+// equations per second through quad_solve against the way task4 used to
+// do it, a discriminant per row then a branch on its sign per row, and the
+// worst error of each against the roots worked out in double
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void scalar_roots(const float* a, const float* b, const float* c,
+                         long n, float* row, float* buf) {
+    // row is a, b, disc and buf 5 floats per equation, as task4 sent them
+    for (long i = 0; i < n; ++i) {
+        row[3 * i] = a[i];
+        row[3 * i + 1] = b[i];
+        row[3 * i + 2] = (b[i] * b[i]) - (4 * a[i] * c[i]);
+    }
+    for (long i = 0; i < n; ++i, row += 3, buf += 5) {
+        float a_coeff = row[0] * 2.0f;
+        float b_coeff = row[1] * -1.0f;
+        float disc = row[2];
+        if (disc < 0.0f) {
+            float x1r = b_coeff / a_coeff;
+            float x1i = sqrt(fabsf(disc)) / a_coeff;
+            buf[0] = 0.0f;
+            buf[1] = x1r;
+            buf[2] = x1r;
+            buf[3] = x1i;
+            buf[4] = -1.0f * x1i;
+        } else {
+            buf[0] = 1.0f;
+            buf[1] = (b_coeff + sqrtf(disc)) / a_coeff;
+            buf[2] = (b_coeff - sqrtf(disc)) / a_coeff;
+            buf[3] = buf[4] = 0.0f;
+        }
+    }
+}
+
+static double error(double got, double want) {
+    // relative, 0 where the root is 0 and got it
+    return got == want ? 0 : fabs(got - want) / fabs(want);
+}
+
+int main(int argc, char* argv[]) {
+    // -n = equations
+    // -r = times through them
+    // -w = b up to 10^4 rather than 10, so -b + sqrt(disc) cancels
+    long n = 1000000, repeats = 20;
+    double b_range = 10;
+    int opt, failed = 0;
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "n:r:w")) != -1) {
+        switch (opt) {
+            case 'n':
+                n = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || n < 1;
+                break;
+            case 'r':
+                repeats = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || repeats < 1;
+                break;
+            case 'w':
+                b_range = 1e4;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    if (failed || optind != argc) {
+        printf("Usage: %s [-n equations] [-r repeats] [-w]\n", argv[0]);
+        return 1;
+    }
+
+    // a b c in a column each, the same spread as make pipe_bench uses
+    float* a = (float*)malloc(n * 3 * sizeof(float));
+    float* row = (float*)malloc(n * 3 * sizeof(float));
+    float* buf = (float*)malloc(n * 5 * sizeof(float));
+    float* cols = (float*)malloc(n * 4 * sizeof(float));
+    if (!a || !row || !buf || !cols) {
+        printf("Could not malloc\n");
+        return 1;
+    }
+    float* b = a + n;
+    float* c = b + n;
+    float* real = cols;
+    float* x1 = cols + n;
+    float* x2 = cols + 2 * n;
+    float* im = cols + 3 * n;
+    srand(3);
+    for (long i = 0; i < n; ++i) {
+        a[i] = 1 + rand() * 9.0f / RAND_MAX;
+        b[i] = (rand() * 2.0f / RAND_MAX - 1) * b_range;
+        c[i] = rand() * 20.0f / RAND_MAX - 10;
+    }
+
+    double start = now();
+    for (long r = 0; r < repeats; ++r) scalar_roots(a, b, c, n, row, buf);
+    double scalar_time = now() - start;
+    start = now();
+    for (long r = 0; r < repeats; ++r)
+        quad_solve(a, b, c, n, real, x1, x2, im);
+    double kernel_time = now() - start;
+
+    double scalar_error = 0, kernel_error = 0;
+    long mismatched = 0;
+    for (long i = 0; i < n; ++i) {
+        double disc = (double)b[i] * b[i] - 4.0 * a[i] * c[i];
+        double root = sqrt(fabs(disc)), e;
+        mismatched += (buf[5 * i] != 0.0f) != (real[i] != 0.0f);
+        if (disc < 0 || buf[5 * i] == 0.0f || real[i] == 0.0f) continue;
+        double want1 = (-b[i] + root) / (2.0 * a[i]);
+        double want2 = (-b[i] - root) / (2.0 * a[i]);
+        // the smaller root, where the cancellation shows
+        if (fabs(want1) < fabs(want2)) {
+            e = error(buf[5 * i + 1], want1);
+            if (e > scalar_error) scalar_error = e;
+            e = error(x1[i], want1);
+        } else {
+            e = error(buf[5 * i + 2], want2);
+            if (e > scalar_error) scalar_error = e;
+            e = error(x2[i], want2);
+        }
+        if (e > kernel_error) kernel_error = e;
+    }
+
+    double total = (double)n * repeats;
+    printf("%ld equations, b up to %g, %ld times\n", n, b_range, repeats);
+    printf("Scalar: %lf s, %.3e equations/s, worst error %.3g\n",
+           scalar_time, total / scalar_time, scalar_error);
+    printf("quad_solve: %lf s, %.3e equations/s, worst error %.3g\n",
+           kernel_time, total / kernel_time, kernel_error);
+    if (mismatched)
+        printf("%ld rows real in one and not the other\n", mismatched);
+    free(a);
+    free(row);
+    free(buf);
+    free(cols);
+    return 0;
+}
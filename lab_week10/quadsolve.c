@@ -0,0 +1,80 @@
+#include "quadsolve.h"
+
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the real roots come from q = -(b + sign(b) sqrt(disc)) / 2 as q / a and
+// c / q, which never subtracts two numbers close together the way
+// -b +- sqrt(disc) does when b^2 is much bigger than 4ac, the real roots and
+// the complex parts are both worked out for every row and the right ones
+// kept, so there's no branch on the sign of the discriminant
+
+static void solve_one(float a, float b, float c, float* real, float* x1,
+                      float* x2, float* im) {
+    float disc = (b * b) - (4 * a * c);
+    float root = sqrtf(fabsf(disc));
+    float q = -0.5f * (b + copysignf(root, b));
+    // + 0 so a root of exactly 0 prints 0.00 rather than -0.00
+    float r1 = q / a + 0.0f;
+    float r2 = q != 0.0f ? c / q + 0.0f : r1;
+    // q / a is the -b - sqrt root unless b's sign bit is set, -0 included
+    float plus = signbit(b) ? r1 : r2;
+    float minus = signbit(b) ? r2 : r1;
+    float half = -b / (2 * a);
+    int is_complex = disc < 0.0f;
+    *real = is_complex ? 0.0f : 1.0f;
+    *x1 = is_complex ? half : plus;
+    *x2 = is_complex ? half : minus;
+    *im = is_complex ? root / (2 * a) : 0.0f;
+}
+
+#ifdef __SSE2__
+static __m128 select4(__m128 mask, __m128 yes, __m128 no) {
+    return _mm_or_ps(_mm_and_ps(mask, yes), _mm_andnot_ps(mask, no));
+}
+#endif
+
+void quad_solve(const float* a, const float* b, const float* c, long n,
+                float* real, float* x1, float* x2, float* im) {
+    long i = 0;
+#ifdef __SSE2__
+    // four rows a go, the last few on their own
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 four = _mm_set1_ps(4.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 va = _mm_loadu_ps(a + i);
+        __m128 vb = _mm_loadu_ps(b + i);
+        __m128 vc = _mm_loadu_ps(c + i);
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(vb, vb),
+                                 _mm_mul_ps(_mm_mul_ps(four, va), vc));
+        __m128 is_complex = _mm_cmplt_ps(disc, zero);
+        __m128 root = _mm_sqrt_ps(_mm_andnot_ps(sign, disc));
+        __m128 signed_root = _mm_or_ps(root, _mm_and_ps(sign, vb));
+        __m128 q = _mm_mul_ps(_mm_xor_ps(half, sign),
+                              _mm_add_ps(vb, signed_root));
+        __m128 r1 = _mm_add_ps(_mm_div_ps(q, va), zero);
+        __m128 r2 = select4(_mm_cmpneq_ps(q, zero),
+                            _mm_add_ps(_mm_div_ps(vc, q), zero), r1);
+        // all ones where b's sign bit is set
+        __m128 negative_b =
+            _mm_castsi128_ps(_mm_srai_epi32(_mm_castps_si128(vb), 31));
+        __m128 plus = select4(negative_b, r1, r2);
+        __m128 minus = select4(negative_b, r2, r1);
+        __m128 two_a = _mm_add_ps(va, va);
+        __m128 mid = _mm_div_ps(_mm_xor_ps(vb, sign), two_a);
+        _mm_storeu_ps(real + i, _mm_andnot_ps(is_complex, one));
+        _mm_storeu_ps(x1 + i, select4(is_complex, mid, plus));
+        _mm_storeu_ps(x2 + i, select4(is_complex, mid, minus));
+        __m128 imag = _mm_div_ps(root, two_a);
+        _mm_storeu_ps(im + i, _mm_and_ps(is_complex, imag));
+    }
+#endif
+    for (; i < n; ++i)
+        solve_one(a[i], b[i], c[i], &real[i], &x1[i], &x2[i], &im[i]);
+}
@@ -0,0 +1,11 @@
+#ifndef QUADSOLVE_H_INCLUDED
+#define QUADSOLVE_H_INCLUDED
+
+// roots of a x^2 + b x + c for a column of equations at once, real[i] 1
+// with the roots in x1[i] and x2[i], or 0 with the real part in both and
+// the imaginary parts im[i] and -im[i], x1 and x2 in the order task4
+// always printed them, (-b + sqrt) / 2a first
+void quad_solve(const float*, const float*, const float*, long, float*,
+                float*, float*, float*);
+
+#endif
@@ -6,7 +6,8 @@
 #include <unistd.h>
 #include <pthread.h>
 
-#define MSG_EXIT 1
+#include "logship.h"
+
 #define MSG_PRINT_ORDERED 2
 #define MSG_PRINT_UNORDERED 3
 
@@ -18,7 +19,9 @@ int main(int argc, char **argv)
 {
     int rank, size;
     MPI_Comm new_comm;
-    MPI_Init(&argc, &argv);
+    // only the master's io thread talks MPI, one thread at a time
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
@@ -31,42 +34,17 @@ int main(int argc, char **argv)
     return 0;
 }
 
-void* ProcessFunc(void *pArg) // Common function prototype
-{
-	int i = 0, size, nslaves, firstmsg;
-	char buf[256], buf2[256];
-	MPI_Status status;
-	MPI_Comm_size(MPI_COMM_WORLD, &size );
-	
-	int* p = (int*)pArg;
-	nslaves = *p;
-
-	while (nslaves > 0) {
-		MPI_Recv(buf, 256, MPI_CHAR, MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status );
-		switch (status.MPI_TAG) {
-			case MSG_EXIT: nslaves--; break;
-			case MSG_PRINT_UNORDERED:
-				printf("Thread prints: %s", buf);
-				fflush(stdout);
-			break;
-			case MSG_PRINT_ORDERED:
-				firstmsg = status.MPI_SOURCE;
-				for (i=0; i<size-1; i++) {
-					if (i == firstmsg){
-						printf("Thread prints: %s", buf);
-						fflush(stdout);
-					}else {
-						MPI_Recv( buf2, 256, MPI_CHAR, i, MSG_PRINT_ORDERED, MPI_COMM_WORLD, &status );
-						printf("Thread prints: %s", buf2);
-						fflush(stdout);
-					}
-				}
-			break;
-		}
-	}
-	
-
-	return 0;
+void* ProcessFunc(void* pArg) {
+    // slaves ship their lines in frames, ordered lines that come in ahead
+    // of their turn wait rather than the master blocking on the slave whose
+    // turn it is, slaves are world ranks 0 to nslaves - 1
+    int nslaves = *(int*)pArg;
+    if (logship_print_ordered(MPI_COMM_WORLD, 0, nslaves, MSG_PRINT_ORDERED,
+                              "Thread prints: ")) {
+        printf("Could not malloc\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return 0;
 }
 
 /* This is the master */
@@ -90,7 +68,6 @@ int slave_io(MPI_Comm world_comm, MPI_Comm comm)
 	MPI_Comm comm2D;
 	int dims[ndims],coord[ndims];
 	int wrap_around[ndims];
-	char buf[256];
     
     	MPI_Comm_size(world_comm, &masterSize); // size of the master communicator
   	MPI_Comm_size(comm, &size); // size of the slave communicator
@@ -119,15 +96,20 @@ int slave_io(MPI_Comm world_comm, MPI_Comm comm)
 	fflush(stdout);
 */
 
-	sprintf( buf, "Hello from slave %d at Coordinate: (%d, %d)\n", my_rank, coord[0], coord[1]);
-	MPI_Send( buf, strlen(buf) + 1, MPI_CHAR, masterSize-1, MSG_PRINT_ORDERED, world_comm );
-
-	sprintf( buf, "Goodbye from slave %d at Coordinate: (%d, %d)\n", my_rank, coord[0], coord[1]);
-	MPI_Send(buf, strlen(buf) + 1, MPI_CHAR, masterSize-1, MSG_PRINT_ORDERED, world_comm);
-	
-	sprintf(buf, "Slave %d at Coordinate: (%d, %d) is exiting\n", my_rank, coord[0], coord[1]);
-	MPI_Send(buf, strlen(buf) + 1, MPI_CHAR, masterSize-1, MSG_PRINT_ORDERED, world_comm);
-	MPI_Send(buf, 0, MPI_CHAR, masterSize-1, MSG_EXIT, world_comm);
+	// lines are packed into frames, the empty frame logship_close sends at
+	// the end tells the master this slave is done
+	LogShipper log;
+	if (logship_open(&log, world_comm, masterSize-1, LOGSHIP_FRAME_SIZE, LOGSHIP_DELAY)) {
+		printf("Could not malloc\n");
+		MPI_Abort(world_comm, 1);
+	}
+	if (logship_printf(&log, MSG_PRINT_ORDERED, "Hello from slave %d at Coordinate: (%d, %d)\n", my_rank, coord[0], coord[1]) ||
+		logship_printf(&log, MSG_PRINT_ORDERED, "Goodbye from slave %d at Coordinate: (%d, %d)\n", my_rank, coord[0], coord[1]) ||
+		logship_printf(&log, MSG_PRINT_ORDERED, "Slave %d at Coordinate: (%d, %d) is exiting\n", my_rank, coord[0], coord[1])) {
+		printf("Could not malloc\n");
+		MPI_Abort(world_comm, 1);
+	}
+	logship_close(&log);
 
     	MPI_Comm_free( &comm2D );
 	return 0;
@@ -1,145 +1,168 @@
+#include <math.h>
+#include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
-#include <memory.h>
-#include "mpi.h"
-
-#define SENTINEL 0.0
-
-int main(int argc, char *argv[])
-{
-	FILE *pInfile;
-	double x0, x1, x2, x3, x4;
-	double *pX4Buff = NULL;
-	float x;
-	int fileElementCount = 0;
-	int counter = 0;
-
-	int my_rank;
-	int p;
-	MPI_Status status;
-
-	MPI_Init(&argc, &argv);
-	MPI_Comm_rank(MPI_COMM_WORLD, &my_rank); 
-	MPI_Comm_size(MPI_COMM_WORLD, &p);
-
-	switch (my_rank)
-	{ 
-		case 0:
-		{
-			pInfile = fopen("ExpResults.txt","r");
-			fscanf(pInfile, "%d", &fileElementCount);
-
-			pX4Buff = (double*)malloc(fileElementCount * sizeof(double));
-			memset(pX4Buff, 0, fileElementCount * sizeof(double)); // Optional
-
-			// Send the counter to the last process
-			MPI_Send(&fileElementCount, 1, MPI_INT, (p - 1), 0, MPI_COMM_WORLD);
-
-			// Read each element from the file
-			while(counter < fileElementCount)
-			{
-				fscanf(pInfile, "%f", &x);
-				x0 = x;
-				x1 = x0 - (4 * x0) + 7;
-				MPI_Send(&x1, 1, MPI_DOUBLE, 1, 0, MPI_COMM_WORLD);
-				counter++;
-			}
-
-			// File end, send a SENTINEL value to complete calculation
-			fclose(pInfile);
-			pInfile = NULL;
-
-			x1 = SENTINEL;
-			MPI_Send(&x1, 1, MPI_DOUBLE, 1, 0, MPI_COMM_WORLD);
-
-			// Wait for buffer from last node
-			MPI_Recv((void*)pX4Buff, counter, MPI_DOUBLE, (p - 1), 0, MPI_COMM_WORLD, &status);
-
-			// Print results
-			for(int i = 0; i < counter; i++)
-			{
-				printf("Result[%d]: %g\n", i, pX4Buff[i]);
-			}
-			free(pX4Buff);
-			pX4Buff = NULL;
-			break;
-		}
-		case 1:
-		{
-			do
-			{ 
-				MPI_Recv(&x1, 1, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD, &status);
-				if(x1 != SENTINEL)
-				{ 
-					x2 = pow(x1, 3) + sin(x1/8);
-				}
-				else
-				{
-					x2 = SENTINEL;
-				}
-				MPI_Send(&x2, 1, MPI_DOUBLE, 2, 0, MPI_COMM_WORLD);
-			} while (x1 != SENTINEL);
-			break;
-		}
-		case 2:
-		{
-			do
-			{ 
-				MPI_Recv(&x2, 1, MPI_DOUBLE, 1, 0, MPI_COMM_WORLD, &status);
-				if(x2 != SENTINEL)
-				{ 
-					x3 = (2 * pow(x2, 4)) + cos(4 * x2) + (3 * M_PI);
-				}
-				else
-				{
-					x3 = SENTINEL;
-				}
-				MPI_Send(&x3, 1, MPI_DOUBLE, 3, 0, MPI_COMM_WORLD);
-			} while (x2 != SENTINEL);
-			break;
-		}
+#include <unistd.h>
+
+#include "ingest.h"
+#include "pipeline.h"
+
+// x1 = x0 - 4 x0 + 7 as it's read, then x2, x3 and x4 a stage each, spare
+// ranks spread over those three, results print in the order they were read
+
+typedef struct {
+    const char* path;
+    int threads;
+    Ingest in;
+} Reader;
+
+static int read_open(void* arg) {
+    Reader* r = (Reader*)arg;
+    int status = ingest_open(&r->in, r->path, 1, r->threads);
+    if (status)
+        printf(status == 1 ? "Could not read %s\n"
+                           : "%s isn't a count then a number per line\n",
+               r->path);
+    return status;
+}
 
-		case 3:
-		{
-			// Get the file element count first
-			MPI_Recv(&fileElementCount, 1, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD, &status);
-			pX4Buff = (double*)malloc(fileElementCount * sizeof(double));
-			memset(pX4Buff, 0, fileElementCount * sizeof(double));
+static void read_close(void* arg) { ingest_close(&((Reader*)arg)->in); }
+
+static long read_x1(const void* in, long n, void* out, void* arg) {
+    Reader* r = (Reader*)arg;
+    double* x1 = (double*)out;
+    IngestBatch batch;
+    long made = ingest_next(&r->in, n, &batch);
+    if (made < 0) {
+        if (r->in.bad_line < 0)
+            printf("Could not read %s\n", r->path);
+        else
+            printf("Line %ld of %s isn't a number\n", r->in.bad_line,
+                   r->path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (long i = 0; i < made; ++i) {
+        double x0 = batch.cols[0][i];
+        x1[i] = x0 - (4 * x0) + 7;
+    }
+    return made;
+}
 
-			// Now, receive the pipelined data
-			counter = 0;
-			do
-			{ 
-				MPI_Recv(&x3, 1, MPI_DOUBLE, 2, 0, MPI_COMM_WORLD, &status);
-				if(x3 != SENTINEL)
-				{ 
-					x4 = (3 * pow(x3, 2)) - (2 * x3) + (tan(x3) / 3);
+static long stage_x2(const void* in, long n, void* out, void* arg) {
+    const double* x1 = (const double*)in;
+    double* x2 = (double*)out;
+    for (long i = 0; i < n; ++i) x2[i] = pow(x1[i], 3) + sin(x1[i] / 8);
+    return n;
+}
 
-					// Save the result into buffer & increment the buffer counter
-					pX4Buff[counter] = x4;
-					counter++;
-				}
-			} while (x3 != SENTINEL);
+static long stage_x3(const void* in, long n, void* out, void* arg) {
+    const double* x2 = (const double*)in;
+    double* x3 = (double*)out;
+    for (long i = 0; i < n; ++i)
+        x3[i] = (2 * pow(x2[i], 4)) + cos(4 * x2[i]) + (3 * M_PI);
+    return n;
+}
 
-			// End of file reached, send the buffer back to the root
-			if(counter > 0)
-			{
-				MPI_Send(pX4Buff, counter, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
-			}
-			// Clean up
-			free(pX4Buff);
-			pX4Buff = NULL;
-			break;
-		}
-		default:
-		{
-			printf("Process %d unused.\n",my_rank);
-			break;
-		}
-	}
+static long stage_x4(const void* in, long n, void* out, void* arg) {
+    const double* x3 = (const double*)in;
+    double* x4 = (double*)out;
+    for (long i = 0; i < n; ++i)
+        x4[i] = (3 * pow(x3[i], 2)) - (2 * x3[i]) + (tan(x3[i]) / 3);
+    return n;
+}
 
-	MPI_Finalize();
+static long print_x4(const void* in, long n, void* out, void* arg) {
+    const double* x4 = (const double*)in;
+    long* printed = (long*)arg;
+    for (long i = 0; i < n; ++i)
+        printf("Result[%ld]: %g\n", (*printed)++, x4[i]);
+    return n;
+}
 
-  return 0;
+int main(int argc, char* argv[]) {
+    int rank, size;
+    const int root = 0;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // -b = elements per message
+    // -d = messages in flight between two stages
+    // -t = print where each rank's time went
+    // -j = threads parsing the input, default one per processor
+    // -r = ranks per stage, comma separated, otherwise the ranks left over
+    //      go to the stages that can be spread over several
+    PipeOptions opts = {.batch = 256, .depth = 4};
+    int report = 0, opt, failed = 0;
+    const char* replicas = NULL;
+    long threads = 0;
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "b:d:tr:j:")) != -1) {
+        switch (opt) {
+            case 'b':
+                opts.batch = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || opts.batch < 1;
+                break;
+            case 'd':
+                opts.depth = (int)strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || opts.depth < 1;
+                break;
+            case 't':
+                report = 1;
+                break;
+            case 'r':
+                replicas = optarg;
+                break;
+            case 'j':
+                threads = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || threads < 1;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    if (failed || argc - optind > 1) {
+        if (rank == root)
+            printf("Usage: %s [-b batch] [-d depth] [-t] [-r replicas] "
+                   "[-j threads] [file]\n",
+                   argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    Reader reader = {.path = optind < argc ? argv[optind] : "ExpResults.txt",
+                     .threads = (int)threads};
+    long printed = 0;
+    PipeStage stages[] = {
+        {"read", read_x1, sizeof(double), &reader, read_open, read_close},
+        {"x2", stage_x2, sizeof(double), NULL, NULL, NULL},
+        {"x3", stage_x3, sizeof(double), NULL, NULL, NULL},
+        {"x4", stage_x4, sizeof(double), NULL, NULL, NULL},
+        {"print", print_x4, 0, &printed, NULL, NULL},
+    };
+    const int nstages = sizeof(stages) / sizeof(stages[0]);
+    int counts[sizeof(stages) / sizeof(stages[0])];
+    if (replicas && pipe_parse_replicas(replicas, nstages, counts)) {
+        if (rank == root)
+            printf("-r wants %d comma separated counts\n", nstages);
+        MPI_Finalize();
+        return 1;
+    }
+    if (replicas) opts.replicas = counts;
+    PipeStats stats;
+    int status = pipe_run(MPI_COMM_WORLD, stages, nstages, &opts, &stats);
+    if (status == 1 && rank == root)
+        printf("Can't run stages on %s ranks with %d processes, read and "
+               "print only get one\n",
+               replicas, size);
+    if (status) {
+        MPI_Finalize();
+        return 1;
+    }
+    if (stats.first < 0) printf("Process %d unused.\n", rank);
+    fflush(stdout);
+    if (report) pipe_report(MPI_COMM_WORLD, root, stages, &stats);
+
+    MPI_Finalize();
+    return 0;
 }
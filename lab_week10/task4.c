@@ -1,140 +1,182 @@
-#include <math.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ingest.h"
+#include "pipeline.h"
+#include "quadsolve.h"
+
+// rows of a b c as they're read, then the discriminants and roots a batch
+// at a time, then roots.txt in the order the rows were read however many
+// ranks work out roots
+
+typedef struct {
+    const char* path;
+    Ingest in;
+} Reader;
+
+typedef struct {
+    const char* path;
+    FILE* fp;
+    int rows;
+} Writer;
+
+static long read_abc(const void* in, long n, void* out, void* arg) {
+    // a column each of a, b and c for however many rows came
+    Reader* r = (Reader*)arg;
+    IngestBatch batch;
+    long made = ingest_next(&r->in, n, &batch);
+    if (made < 0) {
+        if (r->in.bad_line < 0)
+            printf("Could not read %s\n", r->path);
+        else
+            printf("Line %ld of %s isn't a b c\n", r->in.bad_line, r->path);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    float* col = (float*)out;
+    for (int c = 0; c < 3; ++c)
+        memcpy(col + c * made, batch.cols[c], made * sizeof(float));
+    return made;
+}
 
-#define TAG 0
+static long roots(const void* in, long n, void* out, void* arg) {
+    // discriminants and roots together, a column each of whether the
+    // roots are real, x1 or the real part, x2 or the real part again and
+    // the imaginary part
+    const float* a = (const float*)in;
+    float* col = (float*)out;
+    quad_solve(a, a + n, a + 2 * n, n, col, col + n, col + 2 * n,
+               col + 3 * n);
+    return n;
+}
 
-int main() {
-    FILE *fp;
-    float a_coeff, b_coeff, c_coeff, x1, x2, disc;
-    float x1r, x1i, x2r, x2i;
+static int write_open(void* arg) {
+    Writer* w = (Writer*)arg;
+    w->fp = fopen(w->path, "w");
+    if (!w->fp) {
+        printf("Couldn't open %s\n", w->path);
+        return 1;
+    }
+    fprintf(w->fp, "%d\nx1 x2 x1_real x1_img x2_real x2_img\n", w->rows);
+    return 0;
+}
+
+static void write_close(void* arg) { fclose(((Writer*)arg)->fp); }
+
+static long write_roots(const void* in, long n, void* out, void* arg) {
+    const float* real = (const float*)in;
+    const float* x1 = real + n;
+    const float* x2 = real + 2 * n;
+    const float* im = real + 3 * n;
+    FILE* fp = ((Writer*)arg)->fp;
+    for (long i = 0; i < n; ++i) {
+        if (real[i] == 0.0f)
+            fprintf(fp, "N N %.2f %.2f %.2f %.2f\n", x1[i], im[i], x2[i],
+                    -im[i]);
+        else
+            fprintf(fp, "%.2f %.2f N N N N\n", x1[i], x2[i]);
+    }
+    return n;
+}
 
+int main(int argc, char* argv[]) {
     int rank, size;
-    int num_rows, counter = 0;
-    MPI_Status status;
-    MPI_Init(NULL, NULL);
+    const int root = 0;
+    MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
-    // WRITE PART(a) HERE
-    if (size != 3) {
-        if (rank == 0) printf("Must be 3 processors only\n");
-        MPI_Finalize();
-        exit(0);
-    }
-    switch (rank) {
-        case 0: {
-            // CONTINUE WITH PART (a) HERE
-            fp = fopen("quad.txt", "r");
-            if (!fp) {
-                printf("No quad.txt file\n");
-                MPI_Abort(MPI_COMM_WORLD, 0);
-            }
-
-            fscanf(fp, "%d\n", &num_rows);
-            fscanf(fp, "a b c\n");
-
-            // how many rows to expect
-            MPI_Send(&num_rows, 1, MPI_INT, 1, TAG, MPI_COMM_WORLD);
-
-            float buf[3];
-            while (counter < num_rows) {
-                fscanf(fp, "%f %f %f\n", &a_coeff, &b_coeff, &c_coeff);
-                disc = (b_coeff * b_coeff) - (4 * a_coeff * c_coeff);
-
-                buf[0] = a_coeff;
-                buf[1] = b_coeff;
-                buf[2] = disc;
-                MPI_Send(buf, 3, MPI_FLOAT, 1, TAG, MPI_COMM_WORLD);
-                ++counter;
-            }
-
-            fclose(fp);
-            break;
-        }
-        case 1: {
-            // WRITE PART (b) HERE
-            // how many rows to expect
-            MPI_Recv(&num_rows, 1, MPI_INT, 0, TAG, MPI_COMM_WORLD,
-                     MPI_STATUS_IGNORE);
-            // pass along to next processor
-            MPI_Send(&num_rows, 1, MPI_INT, 2, TAG, MPI_COMM_WORLD);
-
-            float buf[5];
-            while (counter < num_rows) {
-                // receive a, b and discriminator
-                MPI_Recv(buf, 3, MPI_FLOAT, 0, TAG, MPI_COMM_WORLD,
-                         MPI_STATUS_IGNORE);
-                a_coeff = buf[0] * 2.0f;
-                b_coeff = buf[1] * -1.0f;
-                disc = buf[2];
 
-                if (disc < 0.0f) {
-                    // complex
-                    x1r = x2r = b_coeff / a_coeff;
-                    x1i = sqrt(fabsf(disc)) / a_coeff;
-                    x2i = -1.0f * x1i;
-                    buf[0] = 0.0f;
-                    buf[1] = x1r;
-                    buf[2] = x2r;
-                    buf[3] = x1i;
-                    buf[4] = x2i;
-                } else {
-                    // normal
-                    x1 = (b_coeff + sqrtf(disc)) / a_coeff;
-                    x2 = (b_coeff - sqrtf(disc)) / a_coeff;
-                    buf[0] = 1.0f;
-                    buf[1] = x1;
-                    buf[2] = x2;
-                }
-
-                MPI_Send(buf, 5, MPI_FLOAT, 2, TAG, MPI_COMM_WORLD);
-
-                ++counter;
-            }
-
-            break;
-        }
-        case 2: {
-            // WRITE PART (c) HERE
-            fp = fopen("roots.txt", "w");
-            if (!fp) {
-                printf("Couldn't open roots.txt\n");
-                MPI_Abort(MPI_COMM_WORLD, 0);
-            }
-
-            MPI_Recv(&num_rows, 1, MPI_INT, 1, TAG, MPI_COMM_WORLD,
-                     MPI_STATUS_IGNORE);
-
-            fprintf(fp, "%d\nx1 x2 x1_real x1_img x2_real x2_img\n", num_rows);
-
-            float buf[5];
-            while (counter < num_rows) {
-                MPI_Recv(buf, 5, MPI_FLOAT, 1, TAG, MPI_COMM_WORLD,
-                         MPI_STATUS_IGNORE);
-
-                if (buf[0] == 0.0f) {
-                    // complex
-                    x1r = buf[1];
-                    x2r = buf[2];
-                    x1i = buf[3];
-                    x2i = buf[4];
-                    fprintf(fp, "N N %.2f %.2f %.2f %.2f\n", x1r, x1i, x2r,
-                            x2i);
-                } else {
-                    // real
-                    x1 = buf[1];
-                    x2 = buf[2];
-                    fprintf(fp, "%.2f %.2f N N N N\n", x1, x2);
-                }
-
-                ++counter;
-            }
-
-            fclose(fp);
-            break;
+    // -b = rows per message
+    // -d = messages in flight between two stages
+    // -t = print where each rank's time went
+    // -j = threads parsing the input, default one per processor
+    // -r = ranks per stage, comma separated, otherwise the ranks left over
+    //      go to the stages that can be spread over several
+    PipeOptions opts = {.batch = 256, .depth = 4};
+    int report = 0, opt, failed = 0;
+    const char* replicas = NULL;
+    long threads = 0;
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "b:d:tr:j:")) != -1) {
+        switch (opt) {
+            case 'b':
+                opts.batch = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || opts.batch < 1;
+                break;
+            case 'd':
+                opts.depth = (int)strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || opts.depth < 1;
+                break;
+            case 't':
+                report = 1;
+                break;
+            case 'r':
+                replicas = optarg;
+                break;
+            case 'j':
+                threads = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || threads < 1;
+                break;
+            default:
+                failed = 1;
         }
     }
+    if (failed || argc - optind > 2) {
+        if (rank == root)
+            printf("Usage: %s [-b batch] [-d depth] [-t] [-r replicas] "
+                   "[-j threads] [quad.txt [roots.txt]]\n",
+                   argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    const char* in_path = optind < argc ? argv[optind] : "quad.txt";
+    Writer writer = {.path = optind + 1 < argc ? argv[optind + 1]
+                                               : "roots.txt"};
+
+    // the writer puts the row count at the top, so root opens the input
+    // up front, a text file with an a b c line or one columns made
+    int rows = 0;
+    Reader reader = {in_path};
+    if (rank == root) {
+        int status = ingest_open(&reader.in, in_path, 3, (int)threads);
+        if (status == 1)
+            printf("No %s file\n", in_path);
+        else if (status)
+            printf("Bad header in %s\n", in_path);
+        rows = status ? -1 : (int)reader.in.rows;
+    }
+    MPI_Bcast(&rows, 1, MPI_INT, root, MPI_COMM_WORLD);
+    if (rows < 0) {
+        MPI_Finalize();
+        return 1;
+    }
+    writer.rows = rows;
+
+    PipeStage stages[] = {
+        {"read", read_abc, 3 * sizeof(float), &reader, NULL, NULL},
+        // no state, so any spare ranks go here
+        {"roots", roots, 4 * sizeof(float), NULL, NULL, NULL},
+        {"write", write_roots, 0, &writer, write_open, write_close},
+    };
+    const int nstages = sizeof(stages) / sizeof(stages[0]);
+    int counts[sizeof(stages) / sizeof(stages[0])];
+    if (replicas && pipe_parse_replicas(replicas, nstages, counts)) {
+        if (rank == root)
+            printf("-r wants %d comma separated counts\n", nstages);
+        MPI_Finalize();
+        return 1;
+    }
+    if (replicas) opts.replicas = counts;
+    PipeStats stats;
+    int status = pipe_run(MPI_COMM_WORLD, stages, nstages, &opts, &stats);
+    if (status == 1 && rank == root)
+        printf("Can't run stages on %s ranks with %d processes, only roots "
+               "can have more than one\n",
+               replicas, size);
+    if (!status && report) pipe_report(MPI_COMM_WORLD, root, stages, &stats);
+    if (rank == root) ingest_close(&reader.in);
     MPI_Finalize();
-    return 0;
+    return status ? 1 : 0;
 }
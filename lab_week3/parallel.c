@@ -1,21 +1,39 @@
+#include <inttypes.h>
 #include <math.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "bitset.h"
+#include "presieve.h"
+#include "primecount.h"
+#include "primeindex.h"
+#include "primeio.h"
+#include "sieve.h"
+#include "stream.h"
+#include "workqueue.h"
 
 typedef struct PrimeCalcInfo {
-    long start;
-    long increment;
-    long end;
-    long* ptr;
+    int id;
+    long n;
+    const SieveBase* base;
+    WorkQueue* queue;
+    uint64_t* words;  // shared bitset, chunks never share a word
     size_t count;
+    // for the per-worker load report
+    double busy_time;
+    long chunks;
+    long steals;
 } PrimeCalcInfo;
 
-int is_prime(long i);
-int write_to_file(long* arr, size_t len);
+int write_to_file(const PrimeBitset* primes, int threads, int binary);
+int serve_from_index(PrimeIndex* idx, long n, int threads, int binary);
 void* find_primes_thread(void* arg);
-size_t find_primes(long start, long end, long increment, long* ptr);
+size_t find_primes(const SieveBase* base, long start, long end,
+                   uint64_t* words);
 
 int main(int argc, char* argv[]) {
     struct timespec start, finish;
@@ -23,45 +41,140 @@ int main(int argc, char* argv[]) {
     clock_gettime(CLOCK_MONOTONIC, &start);
     double NANOSECONDS_IN_SECOND = 1000000000.0;
 
+    // -b = write a gap encoded binary archive (primes.bin) instead of text
+    // -c = only count the primes, sublinearly, nothing is sieved or written
+    // -m MB = stream chunks to the file through MB of memory, for n whose
+    //         bitset wouldn't fit in RAM
+    // -i file = serve from a prime index (see primes/primequery) when it
+    //           covers n, sieve as usual when it doesn't
+    int binary = 0, count_only = 0;
+    long budget_mb = 0;
+    const char* index_file = NULL;
+    int opt;
+    char* ptr;
+    while ((opt = getopt(argc, argv, "bcm:i:")) != -1) {
+        switch (opt) {
+            case 'b':
+                binary = 1;
+                break;
+            case 'c':
+                count_only = 1;
+                break;
+            case 'm':
+                budget_mb = strtol(optarg, &ptr, 10);
+                if (ptr == optarg || budget_mb < 1) {
+                    printf("Couldn't convert memory budget\n");
+                    return 1;
+                }
+                break;
+            case 'i':
+                index_file = optarg;
+                break;
+            default:
+                printf("Usage: %s [-b] [-c | -m MB | -i index] n t\n",
+                       argv[0]);
+                return 1;
+        }
+    }
+
     // n = search for primes < n
     // t = no. of threads
-    if (argc != 3) {
-        printf("Usage: %s n [t]\n", argv[0]);
+    if (argc - optind != 2) {
+        printf("Usage: %s [-b] [-c | -m MB | -i index] n t\n", argv[0]);
         return 1;
     }
 
     // get n
-    char* ptr;
-    long n = strtol(argv[1], &ptr, 10);
-    if (ptr == argv[1]) {
+    long n = strtol(argv[optind], &ptr, 10);
+    if (ptr == argv[optind]) {
         printf("Couldn't convert n\n");
         return 1;
     }
 
     // get number of threads
     ptr = NULL;
-    long number_threads = strtol(argv[2], &ptr, 10);
-    if (ptr == argv[2]) {
+    long number_threads = strtol(argv[optind + 1], &ptr, 10);
+    if (ptr == argv[optind + 1]) {
         printf("Couldn't convert t\n");
         return 1;
     }
+    if (number_threads < 1) {
+        printf("Need at least 1 thread\n");
+        return 1;
+    }
 
     if (n <= 2) {
         printf("No primes less than 2\n");
         return 0;
     }
 
-    // array to store primes
-    // upper limit to no. of primes < n is n/2
-    // there's probably a tighter upper bound but this is good enough
-    long* primes = (long*)malloc((size_t)(n / 2) * sizeof(*primes));
-    if (!primes) {
+    if (count_only) {
+        // O(n^(3/4)) time and O(sqrt n) memory, so n far past what could
+        // ever be sieved into memory or written out
+        long count = prime_pi(n - 1, (int)number_threads);
+        if (count < 0) {
+            printf("Could not malloc\n");
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        elapsed = (finish.tv_sec - start.tv_sec) +
+                  (finish.tv_nsec - start.tv_nsec) / NANOSECONDS_IN_SECOND;
+        printf("Counting primes: %.3f s\n", elapsed);
+        printf("Found %ld primes less than %ld\n", count, n);
+        return 0;
+    }
+
+    if (index_file) {
+        PrimeIndex idx;
+        if (prime_index_open(&idx, index_file, 0)) {
+            printf("Couldn't open index %s, sieving instead\n", index_file);
+        } else if (idx.header->limit < (uint64_t)n) {
+            printf("Index only covers primes < %" PRIu64 ", sieving instead\n",
+                   idx.header->limit);
+            prime_index_close(&idx);
+        } else {
+            int failed = serve_from_index(&idx, n, (int)number_threads, binary);
+            prime_index_close(&idx);
+            return failed;
+        }
+    }
+
+    if (budget_mb) {
+        // producers sieve and format while the writer drains, in order
+        StreamStats stats;
+        printf("Streaming with %ld threads in %ld MB, %s presieve\n",
+               number_threads, budget_mb, presieve_kernel());
+        if (stream_primes(n, (int)number_threads, (size_t)budget_mb << 20,
+                          binary, binary ? "primes.bin" : "primes.txt",
+                          &stats)) {
+            printf("Could not write to file\n");
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        elapsed = (finish.tv_sec - start.tv_sec) +
+                  (finish.tv_nsec - start.tv_nsec) / NANOSECONDS_IN_SECOND;
+        printf("Slots: %zu of %zu words, peak slot memory: %.1f MB\n",
+               stats.slots, stats.chunk_words, stats.peak_bytes / 1048576.0);
+        printf("Writer: %.3f s writing, %.3f s waiting\n", stats.write_time,
+               stats.wait_time);
+        printf("Found %ld primes less than %ld\n", stats.count, n);
+        printf("Time taken: %.3f s\n", elapsed);
+        return 0;
+    }
+
+    // odd primes up to sqrt(n), every thread crosses off multiples of these
+    SieveBase base;
+    if (sieve_base_init(&base, n)) {
         printf("Could not malloc\n");
         return 1;
     }
 
-    primes[0] = 2;
-    size_t primes_count = 1;
+    // one bit per odd number < n, 2 is handled separately
+    PrimeBitset primes;
+    if (bitset_init(&primes, 1, n)) {
+        printf("Could not malloc\n");
+        return 1;
+    }
 
     clock_gettime(CLOCK_MONOTONIC, &finish);
     elapsed = (finish.tv_sec - start.tv_sec) +
@@ -74,49 +187,66 @@ int main(int argc, char* argv[]) {
     pthread_t tid[number_threads];
     PrimeCalcInfo* infos =
         (PrimeCalcInfo*)malloc((size_t)number_threads * sizeof(*infos));
+    // range is cut into chunks of whole segments, each thread starts with an
+    // even share and steals from the others once it runs out
+    WorkQueue queue;
+    if (workqueue_init(&queue, work_chunks_for(n), (int)number_threads)) {
+        printf("Could not malloc\n");
+        return 1;
+    }
     printf("Spawning %ld threads\n", number_threads);
     for (int i = 0; i < number_threads; ++i) {
-        // multiply by 2 to ignore even numbers
-        // each thread will start with a different number
-        infos[i].start = 3 + 2 * i;
-        infos[i].end = n;
-        // each thread jumps forward the same number, hence will cover all
-        // numbers
-        infos[i].increment = 2 * number_threads;
-        // each thread will have their own array to store the found primes
-        infos[i].ptr =
-            (long*)malloc((size_t)(n / 2 / number_threads) * sizeof(long));
+        infos[i].id = i;
+        infos[i].n = n;
+        infos[i].base = &base;
+        infos[i].queue = &queue;
+        infos[i].words = primes.words;
         pthread_create(&tid[i], NULL, find_primes_thread, &infos[i]);
     }
     printf("Joining\n");
+    // 2 plus the odd primes found by each thread
+    size_t primes_count = 1;
     for (int i = 0; i < number_threads; ++i) {
         pthread_join(tid[i], NULL);
+        if (infos[i].count == (size_t)-1) {
+            printf("Could not malloc\n");
+            return 1;
+        }
+        primes_count += infos[i].count;
     }
-    printf("Copying\n");
-    // from each thread's array of primes, copy into the main array
-    // simple copy, WILL NOT BE SORTED
+    sieve_base_free(&base);
+    workqueue_free(&queue);
+
+    // how evenly the work ended up spread
+    double max_busy = 0, total_busy = 0;
     for (int i = 0; i < number_threads; ++i) {
-        for (size_t k = 0; k < infos[i].count; ++k) {
-            primes[primes_count++] = infos[i].ptr[k];
-        }
-        free(infos[i].ptr);
+        printf("Worker %d: busy %.3f s, %ld chunks, %ld stolen\n", i,
+               infos[i].busy_time, infos[i].chunks, infos[i].steals);
+        total_busy += infos[i].busy_time;
+        if (infos[i].busy_time > max_busy) max_busy = infos[i].busy_time;
     }
+    if (total_busy > 0)
+        printf("Imbalance (max / mean busy): %.3f\n",
+               max_busy * number_threads / total_busy);
     free(infos);
 
     clock_gettime(CLOCK_MONOTONIC, &finish);
     elapsed = (finish.tv_sec - start.tv_sec) +
               (finish.tv_nsec - start.tv_nsec) / NANOSECONDS_IN_SECOND;
     total_time += elapsed;
-    printf("Finding primes: %.3f s\n", elapsed);
+    // which pattern kernel the presieve picked for this CPU, PRIMES_SIMD
+    // can force one
+    printf("Finding primes: %.3f s, %s presieve\n", elapsed,
+           presieve_kernel());
     clock_gettime(CLOCK_MONOTONIC, &start);
 
-    if (write_to_file(primes, primes_count)) {
+    if (write_to_file(&primes, (int)number_threads, binary)) {
         return 1;
     }
 
     printf("Written\n");
 
-    free(primes);
+    bitset_free(&primes);
 
     clock_gettime(CLOCK_MONOTONIC, &finish);
     elapsed = (finish.tv_sec - start.tv_sec) +
@@ -131,43 +261,79 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
-size_t find_primes(long start, long end, long increment, long* ptr) {
-    size_t count = 0;
-    for (long i = start; i < end; i += increment) {
-        if (is_prime(i)) {
-            ptr[count++] = i;
-        }
-    }
-    return count;
+size_t find_primes(const SieveBase* base, long start, long end,
+                   uint64_t* words) {
+    if (start >= end) return 0;
+    if (sieve_bits(base, start, end, words)) return (size_t)-1;
+    return bitset_popcount(words, bitset_words_for(start, end));
 }
 
 void* find_primes_thread(void* arg) {
     PrimeCalcInfo* info = (PrimeCalcInfo*)arg;
-    info->count =
-        find_primes(info->start, info->end, info->increment, info->ptr);
-}
+    struct timespec start, finish;
+    long chunk, lo, hi;
+    int stolen;
+    info->count = 0;
+    info->busy_time = 0;
+    info->chunks = info->steals = 0;
+
+    while (workqueue_take(info->queue, info->id, &chunk, &stolen)) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        work_chunk_range(info->n, chunk, &lo, &hi);
+        size_t found =
+            find_primes(info->base, lo, hi, info->words + chunk * WORK_CHUNK_WORDS);
+        clock_gettime(CLOCK_MONOTONIC, &finish);
 
-int is_prime(long i) {
-    long l = (long)ceil(sqrt((double)i));
-    for (long j = 2; j <= l; ++j) {
-        if (i % j == 0) {
-            return 0;  // found a divisor, not prime
+        if (found == (size_t)-1) {
+            info->count = found;
+            return NULL;
         }
+        info->count += found;
+        info->busy_time += (finish.tv_sec - start.tv_sec) +
+                           (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+        ++info->chunks;
+        info->steals += stolen;
     }
-    return 1;  // no divisors, is prime
+    return NULL;
 }
 
-int write_to_file(long* arr, size_t len) {
-    FILE* f = fopen("primes.txt", "w");
-    if (!f) {
-        printf("Could not open file to write\n");
+int serve_from_index(PrimeIndex* idx, long n, int threads, int binary) {
+    // nothing to sieve, the index bits are copied and written as usual
+    struct timespec start, finish;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    PrimeBitset primes;
+    if (prime_index_bitset(idx, n, &primes)) {
+        printf("Could not malloc\n");
         return 1;
     }
+    long primes_count = prime_index_pi(idx, (uint64_t)n - 1);
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    double read_time = (finish.tv_sec - start.tv_sec) +
+                       (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+    printf("Reading index: %.3f s\n", read_time);
 
-    for (size_t i = 0; i < len; ++i) {
-        fprintf(f, "%ld\n", arr[i]);
-    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int failed = write_to_file(&primes, threads, binary);
+    bitset_free(&primes);
+    if (failed) return 1;
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    double write_time = (finish.tv_sec - start.tv_sec) +
+                        (finish.tv_nsec - start.tv_nsec) / 1000000000.0;
+    printf("Writing to file: %.3f s\n", write_time);
+    printf("Found %ld primes less than %ld\n", primes_count, n);
+    printf("Time taken: %.3f s\n", read_time + write_time);
+    return 0;
+}
 
-    fclose(f);
+int write_to_file(const PrimeBitset* primes, int threads, int binary) {
+    // primes only become numbers here, each thread formats a slice and
+    // writes it at its own offset, so the file comes out sorted
+    // binary archive is about a byte per prime so one thread keeps up
+    int failed = binary ? write_primes_archive(primes, 1, "primes.bin")
+                        : write_primes_file(primes, 1, threads, "primes.txt");
+    if (failed) {
+        printf("Could not write to file\n");
+        return 1;
+    }
     return 0;
 }
@@ -4,11 +4,13 @@
 #include <pthread.h>
 #include <time.h>
 
+#include "primality.h"
+
 int main(int argc, char* argv[]) {
    
     //Get user input for n
-    int n;
-    scanf ("%d",&n);
+    long n;
+    scanf ("%ld",&n);
 
     struct timespec startProgram, endProgram, startComp, endComp;
     
@@ -19,24 +21,19 @@ int main(int argc, char* argv[]) {
     double totalTime;
      
      
-     //Check whether num is prime
-    int is_prime(long i) {
-    long l = (long)ceil(sqrt((double)i));
-    for (long j = 2; j <= l; ++j) {
-        if (i % j == 0) {
-            return 0;  // not prime
-        }
-    }
-    return 1;  // is prime
-    }
 
     //Get computation start time
     clock_gettime(CLOCK_MONOTONIC, &startComp);
-    int primes[n];
+    //On the heap, a stack array of n ints overflows past a few million
+    long* primes = (long*)malloc((n > 0 ? n : 1) * sizeof(long));
+    if (!primes) {
+        printf("Could not malloc\n");
+        return 1;
+    }
 
-    //Find all primes and add to array
-    int counter = 0;
-    for (int i = 1; i <= n; i++){
+    //Find all primes and add to array, is_prime is from the shared library
+    long counter = 0;
+    for (long i = 1; i <= n; i++){
         if (is_prime(i))
         {
             primes[counter] = i;
@@ -57,13 +54,14 @@ int main(int argc, char* argv[]) {
     //Open output primes.txt file
     FILE* f = fopen("primes.txt", "w");
 
-    for (int i = 0; i < counter; i++)
+    for (long i = 0; i < counter; i++)
     {
-        fprintf(f,"%d", primes[i]);
+        fprintf(f,"%ld", primes[i]);
         fprintf(f, "\n");
     }
 
     fclose(f);
+    free(primes);
 
 
     //Get program end time and output
@@ -73,8 +71,8 @@ int main(int argc, char* argv[]) {
 
 
     printf("%lf", totalTime);
+    printf("%s", "\n");
 
-
-   
+    return 0;
 
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "integrands.h"
+
+#include <math.h>
+#include <string.h>
+
+// the integrand from q5, pi over [0, 1]
+static double pi_f(double x) { return 4.0 / (1.0 + x * x); }
+static double pi_F(double x) { return 4.0 * atan(x); }
+
+static double gauss_f(double x) { return exp(-x * x); }
+static double gauss_F(double x) { return 0.886226925452758014 * erf(x); }
+
+// derivative blows up at 0, adaptivity piles intervals up there
+static double sqrt_f(double x) { return sqrt(x); }
+static double sqrt_F(double x) { return 2.0 / 3.0 * x * sqrt(x); }
+
+// integrable singularity at 0, never evaluated there since Gauss-Kronrod
+// nodes are all inside the interval
+static double invsqrt_f(double x) { return 1.0 / sqrt(x); }
+static double invsqrt_F(double x) { return 2.0 * sqrt(x); }
+
+static double log_f(double x) { return log(x); }
+static double log_F(double x) { return x > 0 ? x * log(x) - x : 0.0; }
+
+// narrow spike at 0.3, nearly all the work ends up in one small region
+static double peak_f(double x) {
+    return 1.0 / ((x - 0.3) * (x - 0.3) + 1e-6);
+}
+static double peak_F(double x) { return 1000.0 * atan((x - 0.3) * 1000.0); }
+
+// oscillates faster and faster towards 0, no closed form
+static double sinrecip_f(double x) { return sin(1.0 / x); }
+
+const Integrand integrands[] = {
+    {"pi", pi_f, pi_F, 0.0, 1.0, "4 / (1 + x^2)"},
+    {"gauss", gauss_f, gauss_F, -5.0, 5.0, "exp(-x^2)"},
+    {"sqrt", sqrt_f, sqrt_F, 0.0, 1.0, "sqrt(x)"},
+    {"invsqrt", invsqrt_f, invsqrt_F, 0.0, 1.0, "1 / sqrt(x)"},
+    {"log", log_f, log_F, 0.0, 1.0, "log(x)"},
+    {"peak", peak_f, peak_F, 0.0, 1.0, "1 / ((x - 0.3)^2 + 1e-6)"},
+    {"sinrecip", sinrecip_f, NULL, 0.01, 1.0, "sin(1 / x)"},
+};
+const int integrand_count = sizeof(integrands) / sizeof(*integrands);
+
+const Integrand* integrand_find(const char* name) {
+    for (int i = 0; i < integrand_count; ++i)
+        if (!strcmp(integrands[i].name, name)) return &integrands[i];
+    return NULL;
+}
@@ -0,0 +1,20 @@
+#ifndef INTEGRANDS_H_INCLUDED
+#define INTEGRANDS_H_INCLUDED
+
+typedef double (*IntegrandFn)(double);
+
+typedef struct {
+    const char* name;
+    IntegrandFn f;
+    IntegrandFn antiderivative;  // NULL when there's no closed form
+    double a;                    // default interval
+    double b;
+    const char* description;
+} Integrand;
+
+extern const Integrand integrands[];
+extern const int integrand_count;
+
+const Integrand* integrand_find(const char*);
+
+#endif
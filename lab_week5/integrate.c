@@ -0,0 +1,153 @@
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "integrands.h"
+#include "quadrature.h"
+
+// only root complains, every rank parses the same arguments
+static int is_root;
+
+static void usage(const char* name) {
+    printf("Usage: %s [-l] [-f integrand] [-a lo] [-b hi] [-e abs_tol] "
+           "[-r rel_tol] [-t threads] [-B batch] [-m max_intervals] [-v]\n",
+           name);
+}
+
+static int parse_double(const char* arg, const char* what, double* out) {
+    char* ptr;
+    *out = strtod(arg, &ptr);
+    if (ptr == arg) {
+        if (is_root) printf("Couldn't convert %s\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+static int parse_long(const char* arg, const char* what, long min,
+                      long* out) {
+    char* ptr;
+    *out = strtol(arg, &ptr, 10);
+    if (ptr == arg || *out < min) {
+        if (is_root) printf("Couldn't convert %s\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int num_tasks, rank, provided;
+    const int root = 0;
+
+    // only the main thread of each rank talks MPI, the others just evaluate
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    is_root = rank == root;
+
+    // -l = list the built in integrands
+    // -f name = integrand, pi (the q5 one) by default
+    // -a, -b = interval, the integrand's own by default
+    // -e, -r = stop once error <= max(abs_tol, rel_tol * |result|)
+    // -t = threads per rank
+    // -B = intervals bisected per job handed out
+    // -m = give up past this many intervals
+    // -v = convergence line every time the error drops 10x
+    const char* name = "pi";
+    double a = NAN, b = NAN;
+    QuadOptions opts = {1e-10, 0, 1000000, 1, 16, 0};
+    long value;
+    int list = 0, failed = 0, opt;
+    while (!failed && (opt = getopt(argc, argv, "lf:a:b:e:r:t:B:m:v")) != -1) {
+        switch (opt) {
+            case 'l':
+                list = 1;
+                break;
+            case 'f':
+                name = optarg;
+                break;
+            case 'a':
+                failed = parse_double(optarg, "a", &a);
+                break;
+            case 'b':
+                failed = parse_double(optarg, "b", &b);
+                break;
+            case 'e':
+                failed = parse_double(optarg, "abs_tol", &opts.abs_tol);
+                break;
+            case 'r':
+                failed = parse_double(optarg, "rel_tol", &opts.rel_tol);
+                break;
+            case 't':
+                failed = parse_long(optarg, "threads", 1, &value);
+                opts.threads = (int)value;
+                break;
+            case 'B':
+                failed = parse_long(optarg, "batch", 1, &value);
+                opts.batch = (int)value;
+                break;
+            case 'm':
+                failed = parse_long(optarg, "max_intervals", 1,
+                                    &opts.max_intervals);
+                break;
+            case 'v':
+                opts.verbose = 1;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    const Integrand* in = integrand_find(name);
+    if (!failed && !list && !in) {
+        if (rank == root) printf("Unknown integrand %s, -l lists them\n", name);
+        failed = 1;
+    }
+    if (failed || optind != argc) {
+        if (rank == root && optind != argc) usage(argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (list) {
+        if (rank == root)
+            for (int i = 0; i < integrand_count; ++i)
+                printf("%-10s %-28s [%g, %g]\n", integrands[i].name,
+                       integrands[i].description, integrands[i].a,
+                       integrands[i].b);
+        MPI_Finalize();
+        return 0;
+    }
+    if (isnan(a)) a = in->a;
+    if (isnan(b)) b = in->b;
+
+    if (rank == root) {
+        printf("Integrating %s over [%g, %g], %d ranks x %d threads\n",
+               in->description, a, b, num_tasks, opts.threads);
+        fflush(stdout);
+    }
+
+    QuadResult res;
+    if (quad_integrate(MPI_COMM_WORLD, root, in->f, a, b, &opts, &res)) {
+        printf("Could not malloc\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    quad_report(MPI_COMM_WORLD, root, &res);
+
+    if (rank == root) {
+        printf("Result = %.16g\n", res.result);
+        printf("Estimated error = %.3e%s\n", res.error,
+               res.converged ? "" : " (tolerance not reached)");
+        if (in->antiderivative) {
+            double exact = in->antiderivative(b) - in->antiderivative(a);
+            printf("Actual error = %.3e\n", fabs(res.result - exact));
+        }
+        printf("Intervals: %ld, evaluations: %ld, jobs sent: %ld\n",
+               res.intervals, res.evaluations, res.jobs);
+        printf("Overall time (s): %lf\n", res.elapsed);
+        fflush(stdout);
+    }
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "pi_kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PI_X86 1
+#endif
+
+// sum of 4 / (1 + x^2), x = (i + 0.5) / n, over i in [lo, hi)
+// every kernel keeps several independent accumulators so the adds (and
+// the divides feeding them) overlap, sums a block of PI_BLOCK_TERMS that
+// way, then adds each block into a Neumaier compensated total, so error
+// stays around one rounding per block even at n = 10^10
+
+typedef double (*PiKernel)(long, long, double);
+static PiKernel kernel;
+static const char* kernel_name;
+
+static void compensated_add(double* sum, double* comp, double v) {
+    // Neumaier's variant of Kahan, also right when v is bigger than sum
+    double t = *sum + v;
+    if ((*sum >= 0 ? *sum : -*sum) >= (v >= 0 ? v : -v))
+        *comp += (*sum - t) + v;
+    else
+        *comp += (v - t) + *sum;
+    *sum = t;
+}
+
+static double term(long i, double h) {
+    double x = ((double)i + 0.5) * h;
+    return 4.0 / (1.0 + x * x);
+}
+
+static double sum_scalar(long lo, long hi, double h) {
+    double sum = 0, comp = 0;
+    for (long i = lo; i < hi;) {
+        long end = hi - i > PI_BLOCK_TERMS ? i + PI_BLOCK_TERMS : hi;
+        double a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+        for (; i + 4 <= end; i += 4) {
+            a0 += term(i, h);
+            a1 += term(i + 1, h);
+            a2 += term(i + 2, h);
+            a3 += term(i + 3, h);
+        }
+        for (; i < end; ++i) a0 += term(i, h);
+        compensated_add(&sum, &comp, (a0 + a1) + (a2 + a3));
+    }
+    return sum + comp;
+}
+
+#ifdef PI_X86
+__attribute__((target("avx2,fma"))) static double sum_avx2(long lo, long hi,
+                                                           double h) {
+    // 4 vectors of 4 lanes, 16 terms per iteration
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d hv = _mm256_set1_pd(h);
+    const __m256d step = _mm256_set1_pd(16.0);
+    double sum = 0, comp = 0;
+    long i = lo;
+    while (i < hi) {
+        long end = hi - i > PI_BLOCK_TERMS ? i + PI_BLOCK_TERMS : hi;
+        // indices stay exact in a double, rebuilt each block anyway
+        double base = (double)i + 0.5;
+        __m256d idx0 = _mm256_setr_pd(base, base + 1, base + 2, base + 3);
+        __m256d idx1 = _mm256_add_pd(idx0, _mm256_set1_pd(4.0));
+        __m256d idx2 = _mm256_add_pd(idx0, _mm256_set1_pd(8.0));
+        __m256d idx3 = _mm256_add_pd(idx0, _mm256_set1_pd(12.0));
+        __m256d a0 = _mm256_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+        for (; i + 16 <= end; i += 16) {
+            __m256d x0 = _mm256_mul_pd(idx0, hv);
+            __m256d x1 = _mm256_mul_pd(idx1, hv);
+            __m256d x2 = _mm256_mul_pd(idx2, hv);
+            __m256d x3 = _mm256_mul_pd(idx3, hv);
+            a0 = _mm256_add_pd(
+                a0, _mm256_div_pd(four, _mm256_fmadd_pd(x0, x0, one)));
+            a1 = _mm256_add_pd(
+                a1, _mm256_div_pd(four, _mm256_fmadd_pd(x1, x1, one)));
+            a2 = _mm256_add_pd(
+                a2, _mm256_div_pd(four, _mm256_fmadd_pd(x2, x2, one)));
+            a3 = _mm256_add_pd(
+                a3, _mm256_div_pd(four, _mm256_fmadd_pd(x3, x3, one)));
+            idx0 = _mm256_add_pd(idx0, step);
+            idx1 = _mm256_add_pd(idx1, step);
+            idx2 = _mm256_add_pd(idx2, step);
+            idx3 = _mm256_add_pd(idx3, step);
+        }
+        __m256d a =
+            _mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3));
+        double lanes[4];
+        _mm256_storeu_pd(lanes, a);
+        double block = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        for (; i < end; ++i) block += term(i, h);
+        compensated_add(&sum, &comp, block);
+    }
+    return sum + comp;
+}
+
+__attribute__((target("avx512f"))) static double sum_avx512(long lo, long hi,
+                                                            double h) {
+    // 4 vectors of 8 lanes, 32 terms per iteration
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512d four = _mm512_set1_pd(4.0);
+    const __m512d hv = _mm512_set1_pd(h);
+    const __m512d step = _mm512_set1_pd(32.0);
+    double sum = 0, comp = 0;
+    long i = lo;
+    while (i < hi) {
+        long end = hi - i > PI_BLOCK_TERMS ? i + PI_BLOCK_TERMS : hi;
+        double base = (double)i + 0.5;
+        __m512d idx0 =
+            _mm512_add_pd(_mm512_set1_pd(base),
+                          _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7));
+        __m512d idx1 = _mm512_add_pd(idx0, _mm512_set1_pd(8.0));
+        __m512d idx2 = _mm512_add_pd(idx0, _mm512_set1_pd(16.0));
+        __m512d idx3 = _mm512_add_pd(idx0, _mm512_set1_pd(24.0));
+        __m512d a0 = _mm512_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+        for (; i + 32 <= end; i += 32) {
+            __m512d x0 = _mm512_mul_pd(idx0, hv);
+            __m512d x1 = _mm512_mul_pd(idx1, hv);
+            __m512d x2 = _mm512_mul_pd(idx2, hv);
+            __m512d x3 = _mm512_mul_pd(idx3, hv);
+            a0 = _mm512_add_pd(
+                a0, _mm512_div_pd(four, _mm512_fmadd_pd(x0, x0, one)));
+            a1 = _mm512_add_pd(
+                a1, _mm512_div_pd(four, _mm512_fmadd_pd(x1, x1, one)));
+            a2 = _mm512_add_pd(
+                a2, _mm512_div_pd(four, _mm512_fmadd_pd(x2, x2, one)));
+            a3 = _mm512_add_pd(
+                a3, _mm512_div_pd(four, _mm512_fmadd_pd(x3, x3, one)));
+            idx0 = _mm512_add_pd(idx0, step);
+            idx1 = _mm512_add_pd(idx1, step);
+            idx2 = _mm512_add_pd(idx2, step);
+            idx3 = _mm512_add_pd(idx3, step);
+        }
+        double block = _mm512_reduce_add_pd(
+            _mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3)));
+        for (; i < end; ++i) block += term(i, h);
+        compensated_add(&sum, &comp, block);
+    }
+    return sum + comp;
+}
+#endif
+
+static void pick_kernel(void) {
+    // PI_SIMD=scalar|avx2|avx512 forces a kernel, for testing/benchmarks
+    const char* force = getenv("PI_SIMD");
+    kernel = sum_scalar;
+    kernel_name = "scalar";
+    if (force && !strcmp(force, "scalar")) return;
+#ifdef PI_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") &&
+        !(force && !strcmp(force, "avx2"))) {
+        kernel = sum_avx512;
+        kernel_name = "avx512";
+    } else if (__builtin_cpu_supports("avx2") &&
+               __builtin_cpu_supports("fma")) {
+        kernel = sum_avx2;
+        kernel_name = "avx2";
+    }
+#endif
+}
+
+const char* pi_kernel(void) {
+    if (!kernel) pick_kernel();
+    return kernel_name;
+}
+
+double pi_midpoint_sum(long lo, long hi, long n) {
+    // programs using this are single threaded per process, a plain lazy
+    // init is enough
+    if (!kernel) pick_kernel();
+    return kernel(lo, hi, 1.0 / (double)n);
+}
@@ -0,0 +1,11 @@
+#ifndef PI_KERNEL_H_INCLUDED
+#define PI_KERNEL_H_INCLUDED
+
+// terms summed into vector accumulators before the block total is added
+// to the compensated running sum, keeps the uncompensated part short
+#define PI_BLOCK_TERMS 4096
+
+double pi_midpoint_sum(long, long, long);
+const char* pi_kernel(void);
+
+#endif
@@ -1,35 +1,44 @@
-#include <math.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "pi_kernel.h"
+
 int main(int argc, char* argv[]) {
-    int num_tasks, rank, n;
+    int num_tasks, rank;
+    long n;
     const int root = 0;
     double pi_val = 0.0;
-    double local_sum, start, end;
+    double local_sum = 0.0, start, end;
 
-    MPI_Status stat;
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-    // getting N from root
-    if (rank == root) {
+    // n from the command line, otherwise root asks for it
+    if (argc > 1) {
+        char* ptr;
+        n = strtol(argv[1], &ptr, 10);
+        if (ptr == argv[1] || n < 1) {
+            if (rank == root) printf("Couldn't convert n\n");
+            MPI_Finalize();
+            return 1;
+        }
+    } else if (rank == root) {
         printf("Enter n value:\n");
         fflush(stdout);
-        scanf("%d", &n);
+        scanf("%ld", &n);
     }
     // start timing
     start = MPI_Wtime();
     // broadcast n to all other processes
-    MPI_Bcast(&n, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Bcast(&n, 1, MPI_LONG, root, MPI_COMM_WORLD);
 
-    // each process begins at their rank and increments by same amount
-    // hence will cover a different iteration each
-    for (int i = rank; i < n; i += num_tasks) {
-        local_sum += 4.0 / (1 + pow((2.0 * i + 1.0) / (2.0 * n), 2));
-    }
+    // each process takes a contiguous block of iterations, so the kernel
+    // can run over consecutive i in vector lanes
+    long lo = n * rank / num_tasks;
+    long hi = n * (rank + 1) / num_tasks;
+    if (n > 0) local_sum = pi_midpoint_sum(lo, hi, n);
     // summing onto root
     MPI_Reduce(&local_sum, &pi_val, 1, MPI_DOUBLE, MPI_SUM, root,
                MPI_COMM_WORLD);
@@ -41,6 +50,7 @@ int main(int argc, char* argv[]) {
         pi_val /= (double)n;
 
         printf("Calculated Pi value (Parallel-AlgoI) = %12.9f\n", pi_val);
+        printf("Kernel: %s\n", pi_kernel());
         printf("Overall time (s): %lf\n", end - start);
         fflush(stdout);
     }
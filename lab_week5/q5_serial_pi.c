@@ -1,23 +1,33 @@
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#include "pi_kernel.h"
+
 static long N = 100000000;
 
 int main(int argc, char* argv[]) {
-    int i;
     double sum = 0.0;
     double piVal;
     struct timespec start, end;
     double time_taken;
 
+    // optional n, default N
+    if (argc > 1) {
+        char* ptr;
+        N = strtol(argv[1], &ptr, 10);
+        if (ptr == argv[1] || N < 1) {
+            printf("Couldn't convert n\n");
+            return 1;
+        }
+    }
+
     // Get current clock time.
     clock_gettime(CLOCK_MONOTONIC, &start);
 
-    for (i = 0; i < N; i++) {
-        sum += 4.0 / (1 + pow((2.0 * i + 1.0) / (2.0 * N), 2));
-    }
+    // 4 / (1 + ((2i + 1) / 2N)^2) for every i < N, vectorised and
+    // compensated, see pi_kernel.c
+    sum = pi_midpoint_sum(0, N, N);
     piVal = sum / (double)N;
 
     // Get the clock current time again
@@ -27,6 +37,7 @@ int main(int argc, char* argv[]) {
     time_taken = (time_taken + (end.tv_nsec - start.tv_nsec)) * 1e-9;
 
     printf("Calculated Pi value (Serial-AlgoI) = %12.9f\n", piVal);
+    printf("Kernel: %s\n", pi_kernel());
     printf("Overall time (s): %lf\n", time_taken);  // ts
 
     return 0;
@@ -0,0 +1,512 @@
+#include "quadrature.h"
+
+#include <float.h>
+#include <math.h>
+#include <mpi.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// 15 point Kronrod nodes on [-1, 1], the odd ones are the 7 point Gauss
+// nodes, weights as in QUADPACK's qk15
+static const double xgk[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000};
+static const double wgk[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714};
+static const double wg[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327};
+
+void quad_gk15(IntegrandFn f, double a, double b, QuadInterval* out) {
+    double center = 0.5 * (a + b);
+    double half = 0.5 * (b - a);
+    double fv1[7], fv2[7];
+
+    double fc = f(center);
+    double resg = fc * wg[3];
+    double resk = fc * wgk[7];
+    double resabs = fabs(resk);
+    for (int j = 0; j < 7; ++j) {
+        double dx = half * xgk[j];
+        fv1[j] = f(center - dx);
+        fv2[j] = f(center + dx);
+        double sum = fv1[j] + fv2[j];
+        resk += wgk[j] * sum;
+        resabs += wgk[j] * (fabs(fv1[j]) + fabs(fv2[j]));
+        if (j % 2) resg += wg[j / 2] * sum;
+    }
+
+    // the gauss/kronrod difference overestimates a lot once the rule has
+    // converged, scale it down relative to how far f strays from its mean
+    double reskh = resk * 0.5;
+    double resasc = wgk[7] * fabs(fc - reskh);
+    for (int j = 0; j < 7; ++j)
+        resasc += wgk[j] * (fabs(fv1[j] - reskh) + fabs(fv2[j] - reskh));
+    resasc *= fabs(half);
+    resabs *= fabs(half);
+
+    double err = fabs((resk - resg) * half);
+    if (resasc != 0 && err != 0)
+        err = resasc * fmin(1, pow(200 * err / resasc, 1.5));
+    // can't get better than rounding in the sum itself
+    if (resabs > DBL_MIN / (50 * DBL_EPSILON))
+        err = fmax(50 * DBL_EPSILON * resabs, err);
+
+    out->a = a;
+    out->b = b;
+    out->result = resk * half;
+    out->error = err;
+}
+
+// bisects a batch of intervals, the calling thread plus threads - 1 helpers
+// claim halves off a shared counter
+typedef struct {
+    IntegrandFn f;
+    int threads;
+    pthread_t* tid;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    long generation;
+    int stop;
+    int running;  // helpers still on the current batch
+    // children[2i] and children[2i + 1] are the halves of parents[i]
+    const QuadInterval* parents;
+    QuadInterval* children;
+    long tasks;
+    long next;
+} QuadPool;
+
+static void pool_work(QuadPool* p) {
+    long i;
+    while ((i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED)) <
+           p->tasks) {
+        const QuadInterval* parent = p->parents + i / 2;
+        double mid = 0.5 * (parent->a + parent->b);
+        if (i % 2 == 0)
+            quad_gk15(p->f, parent->a, mid, p->children + i);
+        else
+            quad_gk15(p->f, mid, parent->b, p->children + i);
+    }
+}
+
+static void* pool_thread(void* arg) {
+    QuadPool* p = (QuadPool*)arg;
+    long seen = 0;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->generation == seen)
+            pthread_cond_wait(&p->start, &p->lock);
+        if (p->stop) break;
+        seen = p->generation;
+        pthread_mutex_unlock(&p->lock);
+        pool_work(p);
+        pthread_mutex_lock(&p->lock);
+        if (--p->running == 0) pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+static int pool_init(QuadPool* p, IntegrandFn f, int threads) {
+    p->f = f;
+    p->threads = threads;
+    p->generation = 0;
+    p->stop = 0;
+    p->running = 0;
+    p->tid = (pthread_t*)malloc(threads * sizeof(*p->tid));
+    if (!p->tid) return 1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->start, NULL);
+    pthread_cond_init(&p->done, NULL);
+    for (int i = 1; i < threads; ++i)
+        pthread_create(&p->tid[i], NULL, pool_thread, p);
+    return 0;
+}
+
+static void pool_free(QuadPool* p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 1; i < p->threads; ++i) pthread_join(p->tid[i], NULL);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->start);
+    pthread_cond_destroy(&p->done);
+    free(p->tid);
+}
+
+static void pool_bisect(QuadPool* p, const QuadInterval* parents, long count,
+                        QuadInterval* children) {
+    p->parents = parents;
+    p->children = children;
+    p->tasks = 2 * count;
+    p->next = 0;
+    if (p->threads == 1) {
+        pool_work(p);
+        return;
+    }
+    pthread_mutex_lock(&p->lock);
+    p->running = p->threads - 1;
+    ++p->generation;
+    pthread_cond_broadcast(&p->start);
+    pthread_mutex_unlock(&p->lock);
+    pool_work(p);
+    pthread_mutex_lock(&p->lock);
+    while (p->running) pthread_cond_wait(&p->done, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// leaves still worth splitting, largest error on top
+typedef struct {
+    QuadInterval* items;
+    long size;
+    long capacity;
+} QuadHeap;
+
+static int heap_push(QuadHeap* h, const QuadInterval* iv) {
+    if (h->size == h->capacity) {
+        long capacity = h->capacity ? 2 * h->capacity : 1024;
+        QuadInterval* items =
+            (QuadInterval*)realloc(h->items, capacity * sizeof(*items));
+        if (!items) return 1;
+        h->items = items;
+        h->capacity = capacity;
+    }
+    long i = h->size++;
+    while (i > 0 && h->items[(i - 1) / 2].error < iv->error) {
+        h->items[i] = h->items[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    h->items[i] = *iv;
+    return 0;
+}
+
+static QuadInterval heap_pop(QuadHeap* h) {
+    QuadInterval top = h->items[0];
+    QuadInterval last = h->items[--h->size];
+    long i = 0;
+    for (;;) {
+        long child = 2 * i + 1;
+        if (child >= h->size) break;
+        if (child + 1 < h->size &&
+            h->items[child + 1].error > h->items[child].error)
+            ++child;
+        if (h->items[child].error <= last.error) break;
+        h->items[i] = h->items[child];
+        i = child;
+    }
+    if (h->size) h->items[i] = last;
+    return top;
+}
+
+typedef struct {
+    const QuadOptions* opts;
+    int size;
+    QuadHeap heap;
+    // sums over the heap, in flight jobs and frozen leaves, kept as running
+    // totals and recomputed before deciding anything from them
+    double result, error;
+    double pending_result, pending_error;
+    double frozen_result, frozen_error;
+    long frozen;   // too narrow to split any further
+    long pending;  // parents out on other ranks
+    // parents of the job each rank is working on, batch per rank
+    QuadInterval* jobs;
+    long* job_count;
+    int* idle;
+    int idle_count;
+    long jobs_sent;
+    double next_report;
+    double start;
+} QuadManager;
+
+static void manager_resum(QuadManager* m) {
+    m->result = m->error = 0;
+    for (long i = 0; i < m->heap.size; ++i) {
+        m->result += m->heap.items[i].result;
+        m->error += m->heap.items[i].error;
+    }
+    m->pending_result = m->pending_error = 0;
+    for (int r = 0; r < m->size; ++r)
+        for (long i = 0; i < m->job_count[r]; ++i) {
+            m->pending_result += m->jobs[r * m->opts->batch + i].result;
+            m->pending_error += m->jobs[r * m->opts->batch + i].error;
+        }
+}
+
+static double manager_goal(const QuadManager* m) {
+    double result = m->result + m->pending_result + m->frozen_result;
+    return fmax(m->opts->abs_tol, m->opts->rel_tol * fabs(result));
+}
+
+static int manager_converged(QuadManager* m) {
+    double error = m->error + m->pending_error + m->frozen_error;
+    if (error > manager_goal(m)) return 0;
+    manager_resum(m);
+    return m->error + m->pending_error + m->frozen_error <= manager_goal(m);
+}
+
+static long manager_take(QuadManager* m, QuadInterval* out) {
+    // worst leaves first, each bisection adds one leaf so stop short of
+    // max_intervals
+    long leaves = m->heap.size + m->frozen + 2 * m->pending;
+    long count = 0;
+    while (count < m->opts->batch && m->heap.size &&
+           leaves + count < m->opts->max_intervals) {
+        QuadInterval iv = heap_pop(&m->heap);
+        m->result -= iv.result;
+        m->error -= iv.error;
+        // the halves would share all their nodes, nothing left to gain
+        if (iv.b - iv.a <= 100 * DBL_EPSILON * (fabs(iv.a) + fabs(iv.b))) {
+            m->frozen_result += iv.result;
+            m->frozen_error += iv.error;
+            ++m->frozen;
+            continue;
+        }
+        out[count++] = iv;
+    }
+    return count;
+}
+
+static int manager_add(QuadManager* m, const QuadInterval* children,
+                       long count) {
+    for (long i = 0; i < count; ++i) {
+        if (heap_push(&m->heap, children + i)) return 1;
+        m->result += children[i].result;
+        m->error += children[i].error;
+    }
+    return 0;
+}
+
+static void manager_progress(QuadManager* m) {
+    // a line each time the error estimate drops by another factor of 10
+    double error = m->error + m->pending_error + m->frozen_error;
+    if (!m->opts->verbose || error > m->next_report) return;
+    printf("intervals %ld, result %.16g, error %.3e, time %.6f s\n",
+           m->heap.size + m->frozen + m->pending,
+           m->result + m->pending_result + m->frozen_result, error,
+           MPI_Wtime() - m->start);
+    fflush(stdout);
+    m->next_report = error / 10;
+}
+
+static int manager_receive(QuadManager* m, MPI_Comm comm,
+                           QuadInterval* children) {
+    MPI_Status status;
+    int n;
+    MPI_Probe(MPI_ANY_SOURCE, QUAD_RESULT_TAG, comm, &status);
+    MPI_Get_count(&status, MPI_DOUBLE, &n);
+    MPI_Recv(children, n, MPI_DOUBLE, status.MPI_SOURCE, QUAD_RESULT_TAG,
+             comm, MPI_STATUS_IGNORE);
+    int r = status.MPI_SOURCE;
+    for (long i = 0; i < m->job_count[r]; ++i) {
+        m->pending_result -= m->jobs[r * m->opts->batch + i].result;
+        m->pending_error -= m->jobs[r * m->opts->batch + i].error;
+    }
+    m->pending -= m->job_count[r];
+    m->job_count[r] = 0;
+    m->idle[m->idle_count++] = r;
+    if (manager_add(m, children, n / 4)) return 1;
+    manager_progress(m);
+    return 0;
+}
+
+static int manage(MPI_Comm comm, int root, QuadPool* pool, double a, double b,
+                  const QuadOptions* opts, QuadResult* out) {
+    QuadManager m = {0};
+    m.opts = opts;
+    m.start = MPI_Wtime();
+    MPI_Comm_size(comm, &m.size);
+    m.jobs = (QuadInterval*)malloc(m.size * opts->batch * sizeof(*m.jobs));
+    m.job_count = (long*)calloc(m.size, sizeof(*m.job_count));
+    m.idle = (int*)malloc(m.size * sizeof(*m.idle));
+    QuadInterval* local = (QuadInterval*)malloc(opts->batch * sizeof(*local));
+    QuadInterval* children =
+        (QuadInterval*)malloc(2 * opts->batch * sizeof(*children));
+    int failed = !m.jobs || !m.job_count || !m.idle || !local || !children;
+    if (!failed) {
+        for (int r = 0; r < m.size; ++r)
+            if (r != root) m.idle[m.idle_count++] = r;
+    }
+
+    QuadInterval whole;
+    quad_gk15(pool->f, a, b, &whole);
+    failed = failed || manager_add(&m, &whole, 1);
+    m.next_report = INFINITY;
+    if (!failed) manager_progress(&m);
+
+    while (!failed) {
+        int worked = 0;
+        if (!manager_converged(&m)) {
+            // ranks waiting on us go first, then a batch of our own
+            while (m.idle_count) {
+                int r = m.idle[m.idle_count - 1];
+                long count = manager_take(&m, m.jobs + r * opts->batch);
+                if (!count) break;
+                --m.idle_count;
+                m.job_count[r] = count;
+                m.pending += count;
+                for (long i = 0; i < count; ++i) {
+                    m.pending_result += m.jobs[r * opts->batch + i].result;
+                    m.pending_error += m.jobs[r * opts->batch + i].error;
+                }
+                MPI_Send(m.jobs + r * opts->batch, 4 * count, MPI_DOUBLE, r,
+                         QUAD_JOB_TAG, comm);
+                ++m.jobs_sent;
+            }
+            long count = manager_take(&m, local);
+            if (count) {
+                double t = MPI_Wtime();
+                pool_bisect(pool, local, count, children);
+                out->busy_time += MPI_Wtime() - t;
+                out->bisections += count;
+                failed = manager_add(&m, children, 2 * count);
+                manager_progress(&m);
+                worked = 1;
+            }
+        }
+        if (m.pending == 0) {
+            if (!worked) break;
+            continue;
+        }
+        // nothing of our own to do, wait for a rank, otherwise just pick up
+        // whatever has already come back
+        int available = !worked;
+        if (worked)
+            MPI_Iprobe(MPI_ANY_SOURCE, QUAD_RESULT_TAG, comm, &available,
+                       MPI_STATUS_IGNORE);
+        while (available && !failed && m.pending) {
+            failed = manager_receive(&m, comm, children);
+            MPI_Iprobe(MPI_ANY_SOURCE, QUAD_RESULT_TAG, comm, &available,
+                       MPI_STATUS_IGNORE);
+        }
+    }
+
+    // everyone else is idle by now, or we're bailing out anyway
+    for (int r = 0; r < m.size; ++r)
+        if (r != root)
+            MPI_Send(NULL, 0, MPI_DOUBLE, r, QUAD_STOP_TAG, comm);
+
+    if (!failed) {
+        manager_resum(&m);
+        out->converged = manager_converged(&m);
+        out->result = m.result + m.frozen_result;
+        out->error = m.error + m.frozen_error;
+        out->intervals = m.heap.size + m.frozen;
+        out->jobs = m.jobs_sent;
+        out->elapsed = MPI_Wtime() - m.start;
+    }
+    free(m.heap.items);
+    free(m.jobs);
+    free(m.job_count);
+    free(m.idle);
+    free(local);
+    free(children);
+    return failed;
+}
+
+static void work(MPI_Comm comm, int root, QuadPool* pool,
+                 const QuadOptions* opts, QuadResult* out) {
+    QuadInterval* parents =
+        (QuadInterval*)malloc(opts->batch * sizeof(*parents));
+    QuadInterval* children =
+        (QuadInterval*)malloc(2 * opts->batch * sizeof(*children));
+    if (!parents || !children) {
+        printf("Could not malloc\n");
+        MPI_Abort(comm, 1);
+    }
+    MPI_Status status;
+    int n;
+    for (;;) {
+        MPI_Probe(root, MPI_ANY_TAG, comm, &status);
+        if (status.MPI_TAG == QUAD_STOP_TAG) {
+            MPI_Recv(NULL, 0, MPI_DOUBLE, root, QUAD_STOP_TAG, comm,
+                     MPI_STATUS_IGNORE);
+            break;
+        }
+        MPI_Get_count(&status, MPI_DOUBLE, &n);
+        MPI_Recv(parents, n, MPI_DOUBLE, root, QUAD_JOB_TAG, comm,
+                 MPI_STATUS_IGNORE);
+        double t = MPI_Wtime();
+        pool_bisect(pool, parents, n / 4, children);
+        out->busy_time += MPI_Wtime() - t;
+        out->bisections += n / 4;
+        MPI_Send(children, 2 * n, MPI_DOUBLE, root, QUAD_RESULT_TAG, comm);
+    }
+    free(parents);
+    free(children);
+}
+
+int quad_integrate(MPI_Comm comm, int root, IntegrandFn f, double a,
+                   double b, const QuadOptions* opts, QuadResult* out) {
+    // root keeps the leaves in a heap by error and hands the worst batch
+    // to whichever rank is free, so ranks that land on the hard region
+    // don't hold the others up, every rank bisects with its own threads
+    // collective, the result is only filled in on root
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    out->busy_time = 0;
+    out->bisections = 0;
+
+    QuadPool pool;
+    if (pool_init(&pool, f, opts->threads)) {
+        printf("Could not malloc\n");
+        MPI_Abort(comm, 1);
+    }
+    int failed = 0;
+    if (rank == root)
+        failed = manage(comm, root, &pool, a, b, opts, out);
+    else
+        work(comm, root, &pool, opts, out);
+    pool_free(&pool);
+
+    // 15 points per half, plus the first look at the whole interval
+    long evaluations = 30 * out->bisections, total = 0;
+    MPI_Reduce(&evaluations, &total, 1, MPI_LONG, MPI_SUM, root, comm);
+    if (rank == root) out->evaluations = total + 15;
+    return failed;
+}
+
+void quad_report(MPI_Comm comm, int root, const QuadResult* res) {
+    // print how busy each rank was so any imbalance is visible
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    double* all_busy = NULL;
+    long* all_bisections = NULL;
+    if (rank == root) {
+        all_busy = (double*)malloc(size * sizeof(*all_busy));
+        all_bisections = (long*)malloc(size * sizeof(*all_bisections));
+        if (!all_busy || !all_bisections) {
+            printf("Could not malloc\n");
+            MPI_Abort(comm, 1);
+        }
+    }
+    MPI_Gather(&res->busy_time, 1, MPI_DOUBLE, all_busy, 1, MPI_DOUBLE, root,
+               comm);
+    MPI_Gather(&res->bisections, 1, MPI_LONG, all_bisections, 1, MPI_LONG,
+               root, comm);
+
+    if (rank == root) {
+        double max_busy = 0, total_busy = 0;
+        for (int i = 0; i < size; ++i) {
+            printf("Rank %d: busy %.3f s, %ld intervals bisected\n", i,
+                   all_busy[i], all_bisections[i]);
+            total_busy += all_busy[i];
+            if (all_busy[i] > max_busy) max_busy = all_busy[i];
+        }
+        if (total_busy > 0)
+            printf("Imbalance (max / mean busy): %.3f\n",
+                   max_busy * size / total_busy);
+        fflush(stdout);
+        free(all_busy);
+        free(all_bisections);
+    }
+}
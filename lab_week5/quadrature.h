@@ -0,0 +1,47 @@
+#ifndef QUADRATURE_H_INCLUDED
+#define QUADRATURE_H_INCLUDED
+
+#include <mpi.h>
+
+#include "integrands.h"
+
+#define QUAD_JOB_TAG 200
+#define QUAD_RESULT_TAG 201
+#define QUAD_STOP_TAG 202
+
+// one leaf of the subdivision, 4 doubles so a batch goes out as one message
+typedef struct {
+    double a;
+    double b;
+    double result;
+    double error;
+} QuadInterval;
+
+typedef struct {
+    double abs_tol;
+    double rel_tol;       // stop once error <= max(abs_tol, rel_tol * |result|)
+    long max_intervals;   // gives up past this many leaves
+    int threads;          // per rank, the calling thread is one of them
+    int batch;            // intervals bisected per job
+    int verbose;          // convergence line every time the error drops 10x
+} QuadOptions;
+
+typedef struct {
+    double result;
+    double error;
+    long intervals;    // leaves at the end
+    long evaluations;  // integrand calls over all ranks
+    long jobs;         // batches handed to other ranks
+    int converged;
+    double elapsed;
+    // this rank's share, for quad_report
+    double busy_time;
+    long bisections;
+} QuadResult;
+
+void quad_gk15(IntegrandFn, double, double, QuadInterval*);
+int quad_integrate(MPI_Comm, int, IntegrandFn, double, double,
+                   const QuadOptions*, QuadResult*);
+void quad_report(MPI_Comm, int, const QuadResult*);
+
+#endif
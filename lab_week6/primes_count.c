@@ -0,0 +1,170 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "dispatch.h"
+#include "primecount.h"
+#include "sieve.h"
+#include "workqueue.h"
+
+// the split count goes in about this many rounds of a run of segments per
+// rank, runs go out in rank order so the leaf heavy low segments are spread
+#define SPLIT_ROUNDS 64
+
+static long split_count(MPI_Comm comm, int root, long x) {
+    // pi(x) with the split count's segments shared between the ranks, each
+    // round the counts below every rank's run come from a prefix sum and
+    // the round's total carries into the next, the total ends up on root
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (x < 2) return 0;
+    PiSplit split;
+    if (pi_split_init(&split, x)) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(comm, 1);
+    }
+    long terms = split.a + 1;
+    long* counts = (long*)malloc(terms * sizeof(*counts));
+    long* weights = (long*)malloc(terms * sizeof(*weights));
+    long* before = (long*)malloc(terms * sizeof(*before));
+    long* carry = (long*)calloc(terms, sizeof(*carry));
+    if (!counts || !weights || !before || !carry) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(comm, 1);
+    }
+
+    long segments = pi_split_segments(&split);
+    long run = segments / ((long)size * SPLIT_ROUNDS);
+    if (run < 1) run = 1;
+    long local = 0, runs_done = 0;
+    double busy_time = 0;
+    for (long round = 0; round < segments; round += run * size) {
+        double run_start = MPI_Wtime();
+        long sum;
+        if (pi_split_block(&split, round + run * rank, run, counts, weights,
+                           &sum)) {
+            printf("Rank %d: Could not malloc\n", rank);
+            MPI_Abort(comm, 1);
+        }
+        busy_time += MPI_Wtime() - run_start;
+        runs_done += round + run * rank < segments;
+
+        MPI_Exscan(counts, before, (int)terms, MPI_LONG, MPI_SUM, comm);
+        // nothing comes before rank 0's run but earlier rounds
+        if (rank == 0)
+            for (long b = 0; b < terms; ++b) before[b] = 0;
+        for (long b = 0; b < terms; ++b)
+            sum += weights[b] * (carry[b] + before[b]);
+        local += sum;
+        MPI_Allreduce(MPI_IN_PLACE, counts, (int)terms, MPI_LONG, MPI_SUM,
+                      comm);
+        for (long b = 0; b < terms; ++b) carry[b] += counts[b];
+    }
+
+    long total = 0;
+    MPI_Reduce(&local, &total, 1, MPI_LONG, MPI_SUM, root, comm);
+    if (rank == root) total += pi_split_ordinary(&split);
+    dispatch_report(comm, root, busy_time, runs_done);
+    pi_split_free(&split);
+    free(counts);
+    free(weights);
+    free(before);
+    free(carry);
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    int num_tasks, rank;
+    long n;
+    const int root = 0;
+    double start, end;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // -s = only the sublinear count, for n too big to sieve
+    int sublinear_only = argc > 1 && strcmp(argv[1], "-s") == 0;
+
+    // getting N from root
+    if (rank == root) {
+        printf("Enter n value:\n");
+        fflush(stdout);
+        scanf("%ld", &n);
+    }
+    // start timing
+    start = MPI_Wtime();
+    // broadcast n to all other processes
+    MPI_Bcast(&n, 1, MPI_LONG, root, MPI_COMM_WORLD);
+
+    // sieve path: chunks handed out like the save programs, but primes are
+    // only ever popcounted, nothing is gathered or written
+    long sieve_count = 0;
+    if (!sublinear_only && n > 2) {
+        SieveBase base;
+        PrimeBitset primes;
+        if (sieve_base_init(&base, n) ||
+            bitset_init(&primes, 1, 1 + WORK_CHUNK_SPAN)) {
+            printf("Rank %d: Could not malloc\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        ChunkDispatcher dispatcher;
+        dispatch_init(&dispatcher, MPI_COMM_WORLD, root, work_chunks_for(n));
+        long chunk, lo, hi, chunks_done = 0, local_count = 0;
+        double busy_time = 0;
+        while (dispatch_next(&dispatcher, &chunk)) {
+            double chunk_start = MPI_Wtime();
+            work_chunk_range(n, chunk, &lo, &hi);
+            if (sieve_bits(&base, lo, hi, primes.words)) {
+                printf("Rank %d: Could not malloc\n", rank);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            local_count +=
+                (long)bitset_popcount(primes.words, bitset_words_for(lo, hi));
+            busy_time += MPI_Wtime() - chunk_start;
+            ++chunks_done;
+        }
+        dispatch_finish(&dispatcher);
+        sieve_base_free(&base);
+        bitset_free(&primes);
+
+        MPI_Reduce(&local_count, &sieve_count, 1, MPI_LONG, MPI_SUM, root,
+                   MPI_COMM_WORLD);
+        // 2 isn't in the odd only bitset
+        sieve_count += 1;
+        dispatch_report(MPI_COMM_WORLD, root, busy_time, chunks_done);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end = MPI_Wtime();
+
+    if (rank == root && !sublinear_only) {
+        printf("Sieve: %ld primes less than %ld\n", n > 2 ? sieve_count : 0, n);
+        printf("Sieve time (s): %lf\n", end - start);
+        fflush(stdout);
+    }
+
+    // sublinear count, about x^(2/3) of sieving and leaves shared between
+    // the ranks, see primecount.h
+    double pi_start = MPI_Wtime();
+    long pi_count = split_count(MPI_COMM_WORLD, root, n - 1);
+    double pi_end = MPI_Wtime();
+
+    if (rank == root) {
+        printf("Sublinear: %ld primes less than %ld\n", pi_count, n);
+        printf("Sublinear time (s): %lf\n", pi_end - pi_start);
+        if (!sublinear_only && n > 2 && pi_count != sieve_count) {
+            printf("Counts differ\n");
+            fflush(stdout);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fflush(stdout);
+    }
+    MPI_Finalize();
+
+    return 0;
+}
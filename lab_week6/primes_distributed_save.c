@@ -3,7 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-int is_prime(long i);
+#include "bitset.h"
+#include "dispatch.h"
+#include "primeio.h"
+#include "sieve.h"
+#include "workqueue.h"
 
 int main(int argc, char* argv[]) {
     int num_tasks, rank;
@@ -26,23 +30,17 @@ int main(int argc, char* argv[]) {
     // broadcast n to all other processes
     MPI_Bcast(&n, 1, MPI_LONG, root, MPI_COMM_WORLD);
 
-    // each process gets array to store primes found
-    long* arr = (long*)malloc((size_t)(n / 2 / num_tasks) * sizeof(*arr));
-    // counts how many elements currently in the array
-    size_t len = 0;
-    // special case for root: it gets known prime 2 as first element
-    // since we start looking for primes starting at 3
-    if (rank == root) {
-        arr[len++] = 2;
-    }
-    // each process starts at different int according to their rank
-    // and leap by 2 (since even numbers aren't prime except 2) multiplied by
-    // num_tasks to ensure each process jumps to different number and all
-    // numbers are covered
-    for (long i = 3 + 2 * rank; i < n; i += 2 * num_tasks) {
-        if (is_prime(i)) {
-            arr[len++] = i;
-        }
+    // range is cut into chunks of whole segments, handed out by root to
+    // whichever process asks next, so a slow process just gets fewer
+    SieveBase base;
+    PrimeBitset primes;
+    // room for a chunk's primes as text, grown as needed
+    char* text = NULL;
+    size_t text_capacity = 0;
+    if (sieve_base_init(&base, n) ||
+        bitset_init(&primes, 1, 1 + WORK_CHUNK_SPAN)) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
 
     // build filename for each process
@@ -54,16 +52,67 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     // each process will write to unique file
-    for (size_t i = 0; i < len; ++i) {
-        fprintf(f, "%ld\n", arr[i]);
+    // special case for root: it gets known prime 2 as first element
+    // since the bitset only holds odd numbers
+    if (rank == root && n > 2) {
+        fprintf(f, "2\n");
     }
+
+    ChunkDispatcher dispatcher;
+    dispatch_init(&dispatcher, MPI_COMM_WORLD, root, work_chunks_for(n));
+    long chunk, lo, hi, chunks_done = 0;
+    double busy_time = 0, output_time = 0;
+    while (dispatch_next(&dispatcher, &chunk)) {
+        double chunk_start = MPI_Wtime();
+        // reuse the one chunk sized bitset for every chunk
+        work_chunk_range(n, chunk, &lo, &hi);
+        primes.lo = lo;
+        primes.hi = hi;
+        if (sieve_bits(&base, lo, hi, primes.words)) {
+            printf("Rank %d: Could not malloc\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        double chunk_sieved = MPI_Wtime();
+        busy_time += chunk_sieved - chunk_start;
+        ++chunks_done;
+
+        // primes are only materialised as numbers here, formatted into one
+        // buffer per chunk, chunks arrive in ascending order so each file is
+        // sorted
+        size_t nwords = bitset_words_for(lo, hi);
+        size_t need = bitset_popcount(primes.words, nwords) * MAX_LINE_BYTES;
+        if (need > text_capacity) {
+            text = (char*)realloc(text, need);
+            text_capacity = need;
+            if (!text) {
+                printf("Rank %d: Could not malloc\n", rank);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        size_t text_len = format_primes(primes.words, nwords, lo, text);
+        fwrite(text, 1, text_len, f);
+        output_time += MPI_Wtime() - chunk_sieved;
+    }
+    dispatch_finish(&dispatcher);
+    double close_start = MPI_Wtime();
     fclose(f);
-    free(arr);
+    output_time += MPI_Wtime() - close_start;
+    sieve_base_free(&base);
+    bitset_free(&primes);
+    free(text);
+
+    dispatch_report(MPI_COMM_WORLD, root, busy_time, chunks_done);
+    // sieving and writing interleave, so report the slowest process of each
+    double times[2] = {busy_time, output_time}, max_times[2];
+    MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, root,
+               MPI_COMM_WORLD);
 
     MPI_Barrier(MPI_COMM_WORLD);
     end = MPI_Wtime();
 
     if (rank == root) {
+        printf("Compute time (s): %lf\n", max_times[0]);
+        printf("Output time (s): %lf\n", max_times[1]);
         printf("Overall time (s): %lf\n", end - start);
         fflush(stdout);
     }
@@ -71,13 +120,3 @@ int main(int argc, char* argv[]) {
 
     return 0;
 }
-
-int is_prime(long i) {
-    long l = (long)ceil(sqrt((double)i));
-    for (long j = 2; j <= l; ++j) {
-        if (i % j == 0) {
-            return 0;  // found a divisor, not prime
-        }
-    }
-    return 1;  // no divisors, is prime
-}
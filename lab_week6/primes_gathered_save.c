@@ -2,8 +2,18 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int is_prime(long i);
+#include "archive.h"
+#include "bitset.h"
+#include "dispatch.h"
+#include "primeio.h"
+#include "sieve.h"
+#include "workqueue.h"
+
+#define CHUNK_IDS_TAG 1
+#define CHUNK_WORDS_TAG 2
 
 int main(int argc, char* argv[]) {
     int num_tasks, rank;
@@ -14,6 +24,8 @@ int main(int argc, char* argv[]) {
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    // -b = write a gap encoded binary archive (primes.bin) instead of text
+    int binary = argc > 1 && !strcmp(argv[1], "-b");
 
     // getting N from root
     if (rank == root) {
@@ -26,75 +38,146 @@ int main(int argc, char* argv[]) {
     // broadcast n to all other processes
     MPI_Bcast(&n, 1, MPI_LONG, root, MPI_COMM_WORLD);
 
-    // each process gets own array to store primes found
-    long* arr = (long*)malloc((size_t)(n / 2 / num_tasks) * sizeof(*arr));
-    // number of elements in array
-    size_t len = 0;
-    // give 2 to root as known prime
-    if (rank == root) {
-        arr[len++] = 2;
+    // range is cut into chunks of whole segments, handed out by root to
+    // whichever process asks next, so a slow process just gets fewer
+    long chunks = work_chunks_for(n);
+    SieveBase base;
+    if (sieve_base_init(&base, n)) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // root sieves straight into a bitset covering every odd number below n,
+    // other processes keep their chunks back to back until the gather
+    PrimeBitset all_primes;
+    if (rank == root && bitset_init(&all_primes, 1, n)) {
+        printf("Could not malloc\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
-    // look for primes
-    for (long i = 3 + 2 * rank; i < n; i += 2 * num_tasks) {
-        if (is_prime(i)) {
-            arr[len++] = i;
+    long* my_chunks = NULL;
+    uint64_t* my_words = NULL;
+    int len = 0, capacity = 0, words_len = 0;
+
+    ChunkDispatcher dispatcher;
+    dispatch_init(&dispatcher, MPI_COMM_WORLD, root, chunks);
+    long chunk, lo, hi, chunks_done = 0;
+    double busy_time = 0;
+    while (dispatch_next(&dispatcher, &chunk)) {
+        double chunk_start = MPI_Wtime();
+        uint64_t* words;
+        if (rank == root) {
+            words = all_primes.words + chunk * WORK_CHUNK_WORDS;
+        } else {
+            if (len == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                my_chunks =
+                    (long*)realloc(my_chunks, capacity * sizeof(*my_chunks));
+                my_words = (uint64_t*)realloc(
+                    my_words, (size_t)capacity * WORK_CHUNK_WORDS *
+                                  sizeof(*my_words));
+                if (!my_chunks || !my_words) {
+                    printf("Rank %d: Could not malloc\n", rank);
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+            }
+            words = my_words + (size_t)len * WORK_CHUNK_WORDS;
+        }
+        work_chunk_range(n, chunk, &lo, &hi);
+        if (sieve_bits(&base, lo, hi, words)) {
+            printf("Rank %d: Could not malloc\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        if (rank != root) {
+            my_chunks[len++] = chunk;
+            // chunks come out ascending, only the last can be short
+            words_len = (len - 1) * WORK_CHUNK_WORDS +
+                        (int)bitset_words_for(lo, hi);
+        }
+        busy_time += MPI_Wtime() - chunk_start;
+        ++chunks_done;
     }
+    dispatch_finish(&dispatcher);
+    sieve_base_free(&base);
 
     // on root, allocate these arrays
-    // all_len will be array representing number of primes found by each process
-    // displacements will be array representing where to start copying the
-    // received primes from each process into main array on root
-    int *all_len, *displacements;
+    // all_len will be array representing number of chunks from each process
+    int* all_len = NULL;
     if (rank == root) {
         all_len = (int*)malloc(num_tasks * sizeof(*all_len));
-        displacements = (int*)malloc(num_tasks * sizeof(*displacements));
+        if (!all_len) {
+            printf("Could not malloc\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
     }
-    // initial gather to know how many primes each process found
+    // initial gather to know how many chunks each process did
     MPI_Gather(&len, 1, MPI_INT, all_len, 1, MPI_INT, root, MPI_COMM_WORLD);
 
-    long* all_arr;
-    int total_len = 0;
-    if (rank == root) {
-        // on root, sum these lengths to allocate array big enough to hold all
-        // primes
-        for (int i = 0; i < num_tasks; ++i) {
-            total_len += all_len[i];
+    if (rank != root && len) {
+        // which chunks, then their words, root drops them straight in place
+        MPI_Send(my_chunks, len, MPI_LONG, root, CHUNK_IDS_TAG,
+                 MPI_COMM_WORLD);
+        MPI_Send(my_words, words_len, MPI_UINT64_T, root, CHUNK_WORDS_TAG,
+                 MPI_COMM_WORLD);
+    } else if (rank == root) {
+        long* ids = (long*)malloc(chunks * sizeof(*ids));
+        int* block_lens = (int*)malloc(chunks * sizeof(*block_lens));
+        int* displacements = (int*)malloc(chunks * sizeof(*displacements));
+        if (!ids || !block_lens || !displacements) {
+            printf("Could not malloc\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
-        all_arr = (long*)malloc(total_len * sizeof(*all_arr));
-        // calculate the displacements from which each processes' primes will
-        // start being copied into main array
-        displacements[0] = 0;
-        for (int i = 1; i < num_tasks; ++i) {
-            displacements[i] = displacements[i - 1] + all_len[i - 1];
+        for (int i = 0; i < num_tasks; ++i) {
+            if (i == root || !all_len[i]) continue;
+            MPI_Recv(ids, all_len[i], MPI_LONG, i, CHUNK_IDS_TAG,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // scatter this process' chunks into the right spots of the bitset
+            for (int k = 0; k < all_len[i]; ++k) {
+                work_chunk_range(n, ids[k], &lo, &hi);
+                displacements[k] = (int)(ids[k] * WORK_CHUNK_WORDS);
+                block_lens[k] = (int)bitset_words_for(lo, hi);
+            }
+            MPI_Datatype chunk_type;
+            MPI_Type_indexed(all_len[i], block_lens, displacements,
+                             MPI_UINT64_T, &chunk_type);
+            MPI_Type_commit(&chunk_type);
+            MPI_Recv(all_primes.words, 1, chunk_type, i, CHUNK_WORDS_TAG,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Type_free(&chunk_type);
         }
+        free(ids);
+        free(block_lens);
+        free(displacements);
     }
+    free(my_chunks);
+    free(my_words);
 
-    // gather variable number of data from processes onto root
-    MPI_Gatherv(arr, len, MPI_LONG, all_arr, all_len, displacements, MPI_LONG,
-                root, MPI_COMM_WORLD);
+    dispatch_report(MPI_COMM_WORLD, root, busy_time, chunks_done);
+    // everything after this on root is output
+    double computed = MPI_Wtime();
 
     // write out from root and deallocate root specific resources
     if (rank == root) {
-        FILE* f = fopen("primes.txt", "w");
-        if (!f) {
-            printf("Could not open file to write\n");
+        // give 2 to root as known prime, bitset only holds odd numbers
+        // primes are only materialised as numbers here, formatted and
+        // written by a thread per core, already sorted
+        int failed =
+            binary ? write_primes_archive(&all_primes, n > 2, "primes.bin")
+                   : write_primes_file(&all_primes, n > 2,
+                                       (int)sysconf(_SC_NPROCESSORS_ONLN),
+                                       "primes.txt");
+        if (failed) {
+            printf("Could not write to file\n");
             return 1;
         }
-        for (size_t i = 0; i < total_len; ++i) {
-            fprintf(f, "%ld\n", all_arr[i]);
-        }
-        fclose(f);
-        free(all_arr);
+        bitset_free(&all_primes);
         free(all_len);
-        free(displacements);
     }
-    free(arr);
 
     MPI_Barrier(MPI_COMM_WORLD);
     end = MPI_Wtime();
 
     if (rank == root) {
+        printf("Compute time (s): %lf\n", computed - start);
+        printf("Output time (s): %lf\n", end - computed);
         printf("Overall time (s): %lf\n", end - start);
         fflush(stdout);
     }
@@ -102,13 +185,3 @@ int main(int argc, char* argv[]) {
 
     return 0;
 }
-
-int is_prime(long i) {
-    long l = (long)ceil(sqrt((double)i));
-    for (long j = 2; j <= l; ++j) {
-        if (i % j == 0) {
-            return 0;  // found a divisor, not prime
-        }
-    }
-    return 1;  // no divisors, is prime
-}
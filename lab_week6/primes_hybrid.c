@@ -0,0 +1,367 @@
+#include <mpi.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bitset.h"
+#include "primeio.h"
+#include "sieve.h"
+#include "workqueue.h"
+
+// one rank per node (or socket), each splitting its block of chunks over a
+// pthread pool, only the main thread of a rank ever calls MPI
+// thread 0 of the pool is always the main thread
+
+typedef struct {
+    int id;
+    int threads;
+    long n;
+    long first_chunk;  // rank's chunks start here, queue ids are relative
+    const SieveBase* base;
+    WorkQueue* queue;
+    PrimeBitset* primes;  // rank's block, chunks never share a word
+    size_t count;
+    double busy_time;
+    // write phase, shared between the pool
+    pthread_barrier_t* barrier;
+    size_t* lens;  // per thread text length of the current round
+    char** text;
+    size_t* text_capacity;
+    int include_two;
+    MPI_File* fh;
+    MPI_Offset* offset;
+    long rounds;
+    int failed;
+} HybridInfo;
+
+void* sieve_thread(void*);
+void* write_thread(void*);
+int run_pool(HybridInfo*, int, void* (*)(void*));
+
+int main(int argc, char* argv[]) {
+    int num_tasks, rank, provided;
+    const int root = 0;
+    double start, sieved, end;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (rank == root) printf("MPI library has no thread support\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // -t threads = pool size per rank, default is this node's cores shared
+    //              between the ranks placed on it
+    // -w = also write primes.txt with MPI-IO
+    long threads = 0;
+    int write_file = 0;
+    int opt;
+    char* ptr;
+    while ((opt = getopt(argc, argv, "t:w")) != -1) {
+        switch (opt) {
+            case 't':
+                threads = strtol(optarg, &ptr, 10);
+                if (ptr == optarg || threads < 1) {
+                    if (rank == root) printf("Couldn't convert t\n");
+                    MPI_Abort(MPI_COMM_WORLD, 1);
+                }
+                break;
+            case 'w':
+                write_file = 1;
+                break;
+            default:
+                if (rank == root)
+                    printf("Usage: %s [-t threads] [-w] n\n", argv[0]);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    if (argc - optind != 1) {
+        if (rank == root) printf("Usage: %s [-t threads] [-w] n\n", argv[0]);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    long n = strtol(argv[optind], &ptr, 10);
+    if (ptr == argv[optind]) {
+        if (rank == root) printf("Couldn't convert n\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // ranks sharing memory are on the same node, node leaders (local rank
+    // 0) are the only ones that take part in the inter-node reduction
+    MPI_Comm node_comm, leader_comm;
+    int node_rank, node_size, nodes;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                        MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank,
+                   &leader_comm);
+    if (rank == root) MPI_Comm_size(leader_comm, &nodes);
+    if (threads == 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN) / node_size;
+        if (threads < 1) threads = 1;
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    start = MPI_Wtime();
+
+    // contiguous block of chunks per rank, in rank order so the file is
+    // sorted, the pool balances within the block by stealing
+    long chunks = work_chunks_for(n);
+    long first_chunk = chunks * rank / num_tasks;
+    long last_chunk = chunks * (rank + 1) / num_tasks;
+    long lo = 1 + first_chunk * WORK_CHUNK_SPAN;
+    long hi = 1 + last_chunk * WORK_CHUNK_SPAN;
+    if (lo > n) lo = n > 1 ? n : 1;
+    if (hi > n) hi = n > 1 ? n : 1;
+
+    SieveBase base;
+    PrimeBitset primes;
+    WorkQueue queue;
+    if (sieve_base_init(&base, n) || bitset_init(&primes, lo, hi) ||
+        workqueue_init(&queue, last_chunk - first_chunk, (int)threads)) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    HybridInfo* infos = (HybridInfo*)calloc((size_t)threads, sizeof(*infos));
+    size_t* lens = (size_t*)calloc((size_t)threads, sizeof(size_t));
+    if (!infos || !lens) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    for (int i = 0; i < threads; ++i) {
+        infos[i].id = i;
+        infos[i].threads = (int)threads;
+        infos[i].n = n;
+        infos[i].first_chunk = first_chunk;
+        infos[i].base = &base;
+        infos[i].queue = &queue;
+        infos[i].primes = &primes;
+        infos[i].lens = lens;
+    }
+    if (run_pool(infos, (int)threads, sieve_thread)) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    sieve_base_free(&base);
+    workqueue_free(&queue);
+
+    // threads -> rank in memory, ranks -> node leader, leaders -> root
+    long rank_count = 0, node_count = 0, total_count = 0;
+    double rank_busy = 0, rank_max_busy = 0, node_busy[2], max_node_busy[2];
+    for (int i = 0; i < threads; ++i) {
+        rank_count += (long)infos[i].count;
+        rank_busy += infos[i].busy_time;
+        if (infos[i].busy_time > rank_max_busy)
+            rank_max_busy = infos[i].busy_time;
+    }
+    MPI_Reduce(&rank_count, &node_count, 1, MPI_LONG, MPI_SUM, 0, node_comm);
+    // slowest thread, and slowest thread as a fraction of the mean
+    node_busy[0] = rank_max_busy;
+    node_busy[1] = rank_busy > 0 ? rank_max_busy * threads / rank_busy : 1.0;
+    MPI_Reduce(node_busy, max_node_busy, 2, MPI_DOUBLE, MPI_MAX, 0,
+               node_comm);
+    if (node_rank == 0) {
+        // root is world rank 0, so also leader rank 0
+        MPI_Reduce(&node_count, &total_count, 1, MPI_LONG, MPI_SUM, 0,
+                   leader_comm);
+        double node_report[2] = {max_node_busy[0], max_node_busy[1]},
+               all_nodes[2];
+        MPI_Reduce(node_report, all_nodes, 2, MPI_DOUBLE, MPI_MAX, 0,
+                   leader_comm);
+        if (rank == root) {
+            max_node_busy[0] = all_nodes[0];
+            max_node_busy[1] = all_nodes[1];
+        }
+    }
+    // 2 isn't in the odd only bitset
+    if (n > 2) total_count += 1;
+    MPI_Barrier(MPI_COMM_WORLD);
+    sieved = MPI_Wtime();
+
+    if (write_file) {
+        // same layout as primes_mpiio_save, but each round the pool formats
+        // one slice per thread and the main thread writes them together
+        int include_two = rank == root && n > 2;
+        MPI_Offset len =
+            (MPI_Offset)formatted_length(primes.words, primes.nwords, lo) +
+            2 * include_two;
+        MPI_Offset offset = 0, total_len;
+        MPI_Exscan(&len, &offset, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+        // result of the scan is undefined on rank 0
+        if (rank == 0) offset = 0;
+        MPI_Allreduce(&len, &total_len, 1, MPI_OFFSET, MPI_SUM,
+                      MPI_COMM_WORLD);
+
+        MPI_File fh;
+        if (MPI_File_open(MPI_COMM_WORLD, "primes.txt",
+                          MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                          &fh) != MPI_SUCCESS) {
+            if (rank == root) printf("Could not open file to write\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        MPI_File_set_size(fh, total_len);
+
+        // every rank has to join each collective write even once it's done
+        size_t round_words = (size_t)threads * WRITE_SLICE_WORDS;
+        long rounds = (long)((primes.nwords + round_words - 1) / round_words),
+             max_rounds;
+        if (rounds == 0 && include_two) rounds = 1;
+        MPI_Allreduce(&rounds, &max_rounds, 1, MPI_LONG, MPI_MAX,
+                      MPI_COMM_WORLD);
+
+        pthread_barrier_t barrier;
+        pthread_barrier_init(&barrier, NULL, (unsigned)threads);
+        char* text = NULL;
+        size_t text_capacity = 0;
+        for (int i = 0; i < threads; ++i) {
+            infos[i].barrier = &barrier;
+            infos[i].text = &text;
+            infos[i].text_capacity = &text_capacity;
+            infos[i].include_two = include_two;
+            infos[i].fh = &fh;
+            infos[i].offset = &offset;
+            infos[i].rounds = max_rounds;
+        }
+        if (run_pool(infos, (int)threads, write_thread)) {
+            printf("Rank %d: Could not malloc\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        pthread_barrier_destroy(&barrier);
+        MPI_File_close(&fh);
+        free(text);
+    }
+    bitset_free(&primes);
+    free(infos);
+    free(lens);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end = MPI_Wtime();
+
+    if (rank == root) {
+        printf("Found %ld primes less than %ld\n", total_count, n);
+        printf("Nodes %d, ranks %d, threads per rank %ld\n", nodes, num_tasks,
+               threads);
+        printf("Slowest thread busy (s): %lf, imbalance (max / mean): %.3f\n",
+               max_node_busy[0], max_node_busy[1]);
+        printf("Compute time (s): %lf\n", sieved - start);
+        if (write_file) printf("Output time (s): %lf\n", end - sieved);
+        printf("Overall time (s): %lf\n", end - start);
+        // one line per run, collected by make scaling
+        printf("scaling,%d,%d,%ld,%ld,%.6f,%.6f,%.6f\n", nodes, num_tasks,
+               threads, n, sieved - start, end - sieved, end - start);
+        fflush(stdout);
+    }
+    if (leader_comm != MPI_COMM_NULL) MPI_Comm_free(&leader_comm);
+    MPI_Comm_free(&node_comm);
+    MPI_Finalize();
+
+    return 0;
+}
+
+int run_pool(HybridInfo* infos, int threads, void* (*fn)(void*)) {
+    // main thread works as thread 0, so it's the one making MPI calls
+    pthread_t tid[threads];
+    for (int i = 1; i < threads; ++i)
+        pthread_create(&tid[i], NULL, fn, &infos[i]);
+    fn(&infos[0]);
+    int failed = infos[0].failed;
+    for (int i = 1; i < threads; ++i) {
+        pthread_join(tid[i], NULL);
+        failed |= infos[i].failed;
+    }
+    return failed;
+}
+
+static double thread_now() {
+    // MPI_Wtime is off limits to pool threads under MPI_THREAD_FUNNELED
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+void* sieve_thread(void* arg) {
+    HybridInfo* info = (HybridInfo*)arg;
+    long chunk, lo, hi;
+    int stolen;
+    info->count = 0;
+    info->busy_time = 0;
+
+    while (workqueue_take(info->queue, info->id, &chunk, &stolen)) {
+        double chunk_start = thread_now();
+        work_chunk_range(info->n, info->first_chunk + chunk, &lo, &hi);
+        uint64_t* words = info->primes->words + chunk * WORK_CHUNK_WORDS;
+        if (sieve_bits(info->base, lo, hi, words)) {
+            info->failed = 1;
+            return NULL;
+        }
+        info->count += bitset_popcount(words, bitset_words_for(lo, hi));
+        info->busy_time += thread_now() - chunk_start;
+    }
+    return NULL;
+}
+
+void* write_thread(void* arg) {
+    HybridInfo* info = (HybridInfo*)arg;
+    const PrimeBitset* primes = info->primes;
+    size_t round_words = (size_t)info->threads * WRITE_SLICE_WORDS;
+
+    for (long r = 0; r < info->rounds; ++r) {
+        // this thread's slice of the round
+        size_t w_lo = (size_t)r * round_words + (size_t)info->id * WRITE_SLICE_WORDS;
+        size_t w_hi = w_lo + WRITE_SLICE_WORDS;
+        if (w_lo > primes->nwords) w_lo = primes->nwords;
+        if (w_hi > primes->nwords) w_hi = primes->nwords;
+        long slice_lo = primes->lo + (long)w_lo * BITSET_WORD_SPAN;
+        int two = r == 0 && info->id == 0 && info->include_two;
+        info->lens[info->id] =
+            formatted_length(primes->words + w_lo, w_hi - w_lo, slice_lo) +
+            2 * two;
+        pthread_barrier_wait(info->barrier);
+
+        // thread 0 sizes the shared buffer, lengths give each slice's place
+        if (info->id == 0) {
+            size_t need = 0;
+            for (int i = 0; i < info->threads; ++i) need += info->lens[i];
+            if (need > *info->text_capacity) {
+                char* grown = (char*)realloc(*info->text, need);
+                if (grown) {
+                    *info->text = grown;
+                    *info->text_capacity = need;
+                }
+            }
+        }
+        pthread_barrier_wait(info->barrier);
+        size_t at = 0;
+        for (int i = 0; i < info->id; ++i) at += info->lens[i];
+        size_t need = at;
+        for (int i = info->id; i < info->threads; ++i) need += info->lens[i];
+        if (need > *info->text_capacity) {
+            // realloc failed, nobody formats but every round still writes
+            info->failed = 1;
+        } else {
+            char* out = *info->text + at;
+            if (two) {
+                memcpy(out, "2\n", 2);
+                out += 2;
+            }
+            format_primes(primes->words + w_lo, w_hi - w_lo, slice_lo, out);
+        }
+        pthread_barrier_wait(info->barrier);
+
+        if (info->id == 0) {
+            size_t round_len = info->failed ? 0 : need;
+            MPI_File_write_at_all(*info->fh, *info->offset, *info->text,
+                                  (int)round_len, MPI_CHAR,
+                                  MPI_STATUS_IGNORE);
+            *info->offset += (MPI_Offset)round_len;
+        }
+        // the next round's lengths only read the bitset, so the next
+        // barrier is enough to keep the buffer still while it's written
+    }
+    return NULL;
+}
@@ -0,0 +1,130 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "primeio.h"
+#include "sieve.h"
+
+int main(int argc, char* argv[]) {
+    int num_tasks, rank;
+    long n;
+    const int root = 0;
+    double start, end;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_tasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    // getting N from root
+    if (rank == root) {
+        printf("Enter n value:\n");
+        fflush(stdout);
+        scanf("%ld", &n);
+    }
+    // start timing
+    start = MPI_Wtime();
+    // broadcast n to all other processes
+    MPI_Bcast(&n, 1, MPI_LONG, root, MPI_COMM_WORLD);
+
+    // each process sieves a contiguous block, blocks are in rank order so
+    // laying them out by rank in the file keeps it sorted
+    long lo, hi;
+    sieve_partition(n, rank, num_tasks, &lo, &hi);
+    SieveBase base;
+    PrimeBitset primes;
+    if (sieve_base_init(&base, n) || bitset_init(&primes, lo, hi) ||
+        sieve_bits(&base, lo, hi, primes.words)) {
+        printf("Rank %d: Could not malloc\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    sieve_base_free(&base);
+    // slowest process to finish sieving, the rest is output
+    double sieve_time = MPI_Wtime() - start, compute_time;
+    MPI_Reduce(&sieve_time, &compute_time, 1, MPI_DOUBLE, MPI_MAX, root,
+               MPI_COMM_WORLD);
+
+    // root writes known prime 2 first, bitset only holds odd numbers
+    int include_two = rank == root && n > 2;
+    // exact number of bytes this block will take as text, then every
+    // process' offset is the sum of the blocks before it
+    MPI_Offset len =
+        (MPI_Offset)formatted_length(primes.words, primes.nwords, lo) +
+        2 * include_two;
+    MPI_Offset offset = 0, total_len;
+    MPI_Exscan(&len, &offset, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+    // result of the scan is undefined on rank 0
+    if (rank == 0) offset = 0;
+    MPI_Allreduce(&len, &total_len, 1, MPI_OFFSET, MPI_SUM, MPI_COMM_WORLD);
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, "primes.txt",
+                      MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                      &fh) != MPI_SUCCESS) {
+        if (rank == root) printf("Could not open file to write\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // drop anything left over from a longer previous run
+    MPI_File_set_size(fh, total_len);
+
+    // format and write one slice at a time to keep buffers small, every
+    // process has to join each collective write even once it's done
+    long rounds = (long)((primes.nwords + WRITE_SLICE_WORDS - 1) /
+                         WRITE_SLICE_WORDS),
+         max_rounds;
+    if (rounds == 0 && include_two) rounds = 1;
+    MPI_Allreduce(&rounds, &max_rounds, 1, MPI_LONG, MPI_MAX, MPI_COMM_WORLD);
+
+    char* text = NULL;
+    size_t text_capacity = 0;
+    for (long r = 0; r < max_rounds; ++r) {
+        size_t w_lo = (size_t)r * WRITE_SLICE_WORDS;
+        size_t w_hi = w_lo + WRITE_SLICE_WORDS;
+        if (w_lo > primes.nwords) w_lo = primes.nwords;
+        if (w_hi > primes.nwords) w_hi = primes.nwords;
+
+        size_t need =
+            bitset_popcount(primes.words + w_lo, w_hi - w_lo) * MAX_LINE_BYTES +
+            2;
+        if (need > text_capacity) {
+            text = (char*)realloc(text, need);
+            text_capacity = need;
+            if (!text) {
+                printf("Rank %d: Could not malloc\n", rank);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+        // primes are only materialised as numbers here
+        size_t text_len = 0;
+        if (r == 0 && include_two) {
+            memcpy(text, "2\n", 2);
+            text_len = 2;
+        }
+        text_len += format_primes(primes.words + w_lo, w_hi - w_lo,
+                                  lo + (long)w_lo * BITSET_WORD_SPAN,
+                                  text + text_len);
+
+        // collective, lets MPI-IO aggregate everyone's pieces into large
+        // contiguous writes without routing data through root
+        MPI_File_write_at_all(fh, offset, text, (int)text_len, MPI_CHAR,
+                              MPI_STATUS_IGNORE);
+        offset += (MPI_Offset)text_len;
+    }
+    MPI_File_close(&fh);
+    free(text);
+    bitset_free(&primes);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    end = MPI_Wtime();
+
+    if (rank == root) {
+        printf("Compute time (s): %lf\n", compute_time);
+        printf("Output time (s): %lf\n", end - start - compute_time);
+        printf("Overall time (s): %lf\n", end - start);
+        fflush(stdout);
+    }
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "halo.h"
+
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void block_range(int n, int parts, int index, int* start, int* len) {
+    // even split with the remainder spread over the first blocks
+    int base = n / parts, extra = n % parts;
+    *start = index * base + (index < extra ? index : extra);
+    *len = base + (index < extra);
+}
+
+int halo_grid_init(HaloGrid* g, MPI_Comm comm, int nx, int ny, int ghost) {
+    // collective, 1 if the grid is too small to give every rank at least
+    // ghost rows and columns
+    int periods[2] = {0, 0};
+    MPI_Comm_size(comm, &g->size);
+    g->dims[0] = g->dims[1] = 0;
+    MPI_Dims_create(g->size, 2, g->dims);
+    // longer side of the grid gets more ranks, keeps blocks squarer
+    if ((nx < ny) != (g->dims[0] < g->dims[1])) {
+        int tmp = g->dims[0];
+        g->dims[0] = g->dims[1];
+        g->dims[1] = tmp;
+    }
+    if (nx < ghost * g->dims[0] || ny < ghost * g->dims[1]) return 1;
+
+    MPI_Cart_create(comm, 2, g->dims, periods, 1, &g->cart);
+    MPI_Comm_rank(g->cart, &g->rank);
+    MPI_Cart_coords(g->cart, g->rank, 2, g->coords);
+    MPI_Cart_shift(g->cart, 0, 1, &g->up, &g->down);
+    MPI_Cart_shift(g->cart, 1, 1, &g->left, &g->right);
+
+    g->nx = nx;
+    g->ny = ny;
+    block_range(nx, g->dims[0], g->coords[0], &g->row0, &g->rows);
+    block_range(ny, g->dims[1], g->coords[1], &g->col0, &g->cols);
+    g->ghost = ghost;
+    g->stride = g->cols + 2 * ghost;
+
+    // a single ghost row is contiguous, the ghost cells either side of
+    // each row are what breaks it up past that
+    MPI_Type_vector(ghost, g->cols, g->stride, MPI_DOUBLE, &g->row_type);
+    MPI_Type_commit(&g->row_type);
+    MPI_Type_vector(g->rows, ghost, g->stride, MPI_DOUBLE, &g->col_type);
+    MPI_Type_commit(&g->col_type);
+    return 0;
+}
+
+void halo_grid_free(HaloGrid* g) {
+    MPI_Type_free(&g->row_type);
+    MPI_Type_free(&g->col_type);
+    MPI_Comm_free(&g->cart);
+}
+
+double* halo_field_alloc(const HaloGrid* g) {
+    // zeroed, ghosts included
+    return (double*)calloc(
+        (size_t)(g->rows + 2 * g->ghost) * g->stride, sizeof(double));
+}
+
+void halo_start(HaloGrid* g, double* f) {
+    // receives first so the sends can land straight in the ghost cells
+    // tags are the direction the data travels
+    int k = g->ghost;
+    MPI_Irecv(&HALO_AT(g, f, -k, 0), 1, g->row_type, g->up, HALO_TAG_DOWN,
+              g->cart, &g->requests[0]);
+    MPI_Irecv(&HALO_AT(g, f, g->rows, 0), 1, g->row_type, g->down,
+              HALO_TAG_UP, g->cart, &g->requests[1]);
+    MPI_Irecv(&HALO_AT(g, f, 0, -k), 1, g->col_type, g->left, HALO_TAG_RIGHT,
+              g->cart, &g->requests[2]);
+    MPI_Irecv(&HALO_AT(g, f, 0, g->cols), 1, g->col_type, g->right,
+              HALO_TAG_LEFT, g->cart, &g->requests[3]);
+
+    MPI_Isend(&HALO_AT(g, f, 0, 0), 1, g->row_type, g->up, HALO_TAG_UP,
+              g->cart, &g->requests[4]);
+    MPI_Isend(&HALO_AT(g, f, g->rows - k, 0), 1, g->row_type, g->down,
+              HALO_TAG_DOWN, g->cart, &g->requests[5]);
+    MPI_Isend(&HALO_AT(g, f, 0, 0), 1, g->col_type, g->left, HALO_TAG_LEFT,
+              g->cart, &g->requests[6]);
+    MPI_Isend(&HALO_AT(g, f, 0, g->cols - k), 1, g->col_type, g->right,
+              HALO_TAG_RIGHT, g->cart, &g->requests[7]);
+}
+
+void halo_finish(HaloGrid* g) {
+    MPI_Waitall(8, g->requests, MPI_STATUSES_IGNORE);
+}
+
+void halo_exchange(HaloGrid* g, double* f) {
+    halo_start(g, f);
+    halo_finish(g);
+}
+
+void halo_exchange_full(HaloGrid* g, double* f) {
+    // columns first, then whole rows including the ghost columns just
+    // filled, so the corners come from the diagonal neighbours, needed once
+    // a stencil runs more than one sweep per exchange
+    int k = g->ghost, n = k * g->stride;
+    MPI_Irecv(&HALO_AT(g, f, 0, -k), 1, g->col_type, g->left, HALO_TAG_RIGHT,
+              g->cart, &g->requests[0]);
+    MPI_Irecv(&HALO_AT(g, f, 0, g->cols), 1, g->col_type, g->right,
+              HALO_TAG_LEFT, g->cart, &g->requests[1]);
+    MPI_Isend(&HALO_AT(g, f, 0, 0), 1, g->col_type, g->left, HALO_TAG_LEFT,
+              g->cart, &g->requests[2]);
+    MPI_Isend(&HALO_AT(g, f, 0, g->cols - k), 1, g->col_type, g->right,
+              HALO_TAG_RIGHT, g->cart, &g->requests[3]);
+    MPI_Waitall(4, g->requests, MPI_STATUSES_IGNORE);
+
+    // k full rows are contiguous
+    MPI_Irecv(&HALO_AT(g, f, -k, -k), n, MPI_DOUBLE, g->up, HALO_TAG_DOWN,
+              g->cart, &g->requests[0]);
+    MPI_Irecv(&HALO_AT(g, f, g->rows, -k), n, MPI_DOUBLE, g->down,
+              HALO_TAG_UP, g->cart, &g->requests[1]);
+    MPI_Isend(&HALO_AT(g, f, 0, -k), n, MPI_DOUBLE, g->up, HALO_TAG_UP,
+              g->cart, &g->requests[2]);
+    MPI_Isend(&HALO_AT(g, f, g->rows - k, -k), n, MPI_DOUBLE, g->down,
+              HALO_TAG_DOWN, g->cart, &g->requests[3]);
+    MPI_Waitall(4, g->requests, MPI_STATUSES_IGNORE);
+}
+
+int halo_depth_extent(const HaloGrid* g, int step, int* ext) {
+    // region a 5 point stencil can still update on sweep step (0 based)
+    // after a full exchange, as cells past the block on the up, down, left
+    // and right sides
+    // it shrinks by one each sweep, and never reaches past the edge of the
+    // global grid where the ghosts hold the boundary
+    int reach = g->ghost - 1 - step;
+    if (reach < 0) return 1;
+    ext[0] = g->up == MPI_PROC_NULL ? 0 : reach;
+    ext[1] = g->down == MPI_PROC_NULL ? 0 : reach;
+    ext[2] = g->left == MPI_PROC_NULL ? 0 : reach;
+    ext[3] = g->right == MPI_PROC_NULL ? 0 : reach;
+    return 0;
+}
+
+int halo_tune(MPI_Comm comm, int nx, int ny, int max_ghost, double cell_time,
+              HaloTuning* out) {
+    // times exchanges at every width that fits, fits latency and bandwidth
+    // to them, then picks the width with the least modelled time per
+    // iteration: one exchange plus k sweeps over a shrinking region, over k
+    // collective, 1 if not even a single ghost width fits
+    // width 1 is a single round, wider ones need two for the corners
+    // no width past the grid's shorter side can fit, and -k can ask for
+    // any, so that bounds the arrays here
+    if (max_ghost > nx) max_ghost = nx;
+    if (max_ghost > ny) max_ghost = ny;
+    if (max_ghost < 1) return 1;
+    double rounds[max_ghost], bytes[max_ghost], measured[max_ghost];
+    long cells[max_ghost];
+    int widths = 0;
+    const int reps = 20;
+    for (int k = 1; k <= max_ghost; ++k) {
+        HaloGrid g;
+        if (halo_grid_init(&g, comm, nx, ny, k)) break;
+        double* f = halo_field_alloc(&g);
+        if (!f) {
+            printf("Could not malloc\n");
+            MPI_Abort(comm, 1);
+        }
+        MPI_Barrier(g.cart);
+        double start = 0;
+        for (int r = -3; r < reps; ++r) {
+            // a few untimed ones first
+            if (r == 0) start = MPI_Wtime();
+            if (k == 1)
+                halo_exchange(&g, f);
+            else
+                halo_exchange_full(&g, f);
+        }
+        double elapsed = (MPI_Wtime() - start) / reps;
+        MPI_Allreduce(&elapsed, &measured[widths], 1, MPI_DOUBLE, MPI_MAX,
+                      g.cart);
+
+        // the biggest block with all 4 neighbours is the one everyone
+        // waits on
+        long block[2] = {g.rows, g.cols}, biggest[2];
+        MPI_Allreduce(block, biggest, 2, MPI_LONG, MPI_MAX, g.cart);
+        rounds[widths] = k == 1 ? 1 : 2;
+        bytes[widths] = (2.0 * k * biggest[0] +
+                         2.0 * k * (biggest[1] + (k == 1 ? 0 : 2 * k))) *
+                        sizeof(double);
+        long rows = biggest[0], cols = biggest[1];
+        cells[widths] = 0;
+        for (int reach = 0; reach < k; ++reach)
+            cells[widths] += (rows + 2 * reach) * (cols + 2 * reach);
+        ++widths;
+        free(f);
+        halo_grid_free(&g);
+    }
+    if (!widths) return 1;
+
+    // least squares for time = latency * rounds + bytes / bandwidth
+    double rr = 0, rb = 0, bb = 0, rt = 0, bt = 0;
+    for (int i = 0; i < widths; ++i) {
+        rr += rounds[i] * rounds[i];
+        rb += rounds[i] * bytes[i];
+        bb += bytes[i] * bytes[i];
+        rt += rounds[i] * measured[i];
+        bt += bytes[i] * measured[i];
+    }
+    double det = rr * bb - rb * rb;
+    double latency = measured[0], per_byte = 0;
+    if (widths > 1 && det > 0) {
+        latency = (rt * bb - bt * rb) / det;
+        per_byte = (rr * bt - rb * rt) / det;
+    }
+    // noise can push either below zero on a quiet machine
+    if (latency < 0) latency = 0;
+    if (per_byte < 0) per_byte = 0;
+
+    out->latency = latency;
+    out->bandwidth = per_byte > 0 ? 1 / per_byte : INFINITY;
+    out->cell_time = cell_time;
+    out->ghost = 1;
+    out->predicted = INFINITY;
+    for (int i = 0; i < widths; ++i) {
+        int k = i + 1;
+        double t = (latency * rounds[i] + per_byte * bytes[i] +
+                    cell_time * cells[i]) / k;
+        if (t < out->predicted) {
+            out->predicted = t;
+            out->ghost = k;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef HALO_H_INCLUDED
+#define HALO_H_INCLUDED
+
+#include <mpi.h>
+
+#define HALO_TAG_UP 300
+#define HALO_TAG_DOWN 301
+#define HALO_TAG_LEFT 302
+#define HALO_TAG_RIGHT 303
+
+// nx x ny grid split in blocks over a 2-D cartesian process grid, the
+// first nx % dims[0] block rows get a row more, same for columns
+// a field is the local block plus a ghost border, row major, ghost cells on
+// the edge of the global grid are never written so they can hold fixed
+// boundary values
+typedef struct {
+    MPI_Comm cart;
+    int rank;
+    int size;
+    int dims[2];
+    int coords[2];
+    int nx, ny;      // global rows, cols
+    int rows, cols;  // local block
+    int row0, col0;  // global index of the block's first cell
+    int ghost;       // border width
+    int stride;      // cols + 2 * ghost
+    int up, down, left, right;  // MPI_PROC_NULL off the edge
+    MPI_Datatype row_type;      // ghost rows of the block, cols wide
+    MPI_Datatype col_type;      // ghost columns of the block, rows tall
+    MPI_Request requests[8];
+} HaloGrid;
+
+// cell (i, j) of the local block, i and j from -ghost to rows/cols + ghost - 1
+#define HALO_AT(g, f, i, j) \
+    ((f)[((i) + (g)->ghost) * (g)->stride + (j) + (g)->ghost])
+
+// what halo_tune measured and the ghost width it settled on, times are
+// for the slowest rank
+typedef struct {
+    double latency;    // s per round of messages
+    double bandwidth;  // bytes per s
+    double cell_time;  // s per cell update, from the caller
+    int ghost;
+    double predicted;  // s per iteration at that width
+} HaloTuning;
+
+int halo_grid_init(HaloGrid*, MPI_Comm, int, int, int);
+void halo_grid_free(HaloGrid*);
+double* halo_field_alloc(const HaloGrid*);
+void halo_start(HaloGrid*, double*);
+void halo_finish(HaloGrid*);
+void halo_exchange(HaloGrid*, double*);
+void halo_exchange_full(HaloGrid*, double*);
+int halo_depth_extent(const HaloGrid*, int, int*);
+int halo_tune(MPI_Comm, int, int, int, double, HaloTuning*);
+
+#endif
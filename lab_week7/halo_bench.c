@@ -0,0 +1,307 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "halo.h"
+
+// every way of doing the same exchange, q1.c and q2.c are the first two
+enum { ISEND, SENDRECV, PERSISTENT, NEIGHBOR, PUT, STRATEGIES };
+static const char* strategy_names[STRATEGIES] = {
+    "isend", "sendrecv", "persistent", "neighbor", "put"};
+
+// state a strategy sets up once per grid and reuses every exchange
+typedef struct {
+    MPI_Request persistent[8];
+    MPI_Comm neighbor_comm;
+    int counts[4];
+    MPI_Aint send_displs[4], recv_displs[4];
+    MPI_Datatype types[4];
+    MPI_Win win;
+} Exchange;
+
+int parse_list(const char*, int*, int);
+int exchange_setup(HaloGrid*, double*, int, Exchange*);
+void exchange_free(int, Exchange*);
+void exchange(HaloGrid*, double*, int, Exchange*);
+long check_ghosts(const HaloGrid*, const double*);
+
+int main(int argc, char* argv[]) {
+    int rank, size;
+    const int root = 0;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // -r = exchanges timed per strategy, after a few untimed ones
+    // -w = comma separated halo widths
+    // -n = comma separated block sizes, every rank gets an n x n block
+    long reps = 200;
+    int widths[16] = {1, 2, 4}, nwidths = 3;
+    int blocks[16] = {16, 64, 256, 1024}, nblocks = 4;
+    int opt, failed = 0;
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "r:w:n:")) != -1) {
+        switch (opt) {
+            case 'r':
+                reps = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || reps < 1;
+                break;
+            case 'w':
+                failed = (nwidths = parse_list(optarg, widths, 16)) < 1;
+                break;
+            case 'n':
+                failed = (nblocks = parse_list(optarg, blocks, 16)) < 1;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    if (failed || optind != argc) {
+        if (rank == root)
+            printf("Usage: %s [-r reps] [-w w1,w2,..] [-n n1,n2,..]\n",
+                   argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    // same split halo_grid_init will pick, so n x n blocks everywhere
+    int dims[2] = {0, 0};
+    MPI_Dims_create(size, 2, dims);
+    if (rank == root) {
+        printf("# %d x %d ranks, %ld exchanges each\n", dims[0], dims[1],
+               reps);
+        printf("strategy,width,block,bytes,us_per_exchange,mb_per_s\n");
+        fflush(stdout);
+    }
+
+    int status = 0;
+    for (int wi = 0; wi < nwidths; ++wi) {
+        for (int bi = 0; bi < nblocks; ++bi) {
+            int w = widths[wi], n = blocks[bi];
+            if (w > n) continue;
+            HaloGrid g;
+            halo_grid_init(&g, MPI_COMM_WORLD, n * dims[0], n * dims[1], w);
+            double* f = halo_field_alloc(&g);
+            if (!f) {
+                printf("Could not malloc\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            // what an interior rank sends, 4 neighbours
+            double bytes = 4.0 * w * n * sizeof(double);
+            double best = 0;
+            int best_strategy = -1;
+
+            for (int s = 0; s < STRATEGIES; ++s) {
+                Exchange ex;
+                if (exchange_setup(&g, f, s, &ex)) {
+                    if (rank == root)
+                        printf("# %s not supported here, skipped\n",
+                               strategy_names[s]);
+                    continue;
+                }
+
+                // each cell holds its global index, ghosts must end up
+                // holding their neighbour's
+                for (int i = -w; i < g.rows + w; ++i)
+                    for (int j = -w; j < g.cols + w; ++j)
+                        HALO_AT(&g, f, i, j) =
+                            i < 0 || j < 0 || i >= g.rows || j >= g.cols
+                                ? -1.0
+                                : (double)(g.row0 + i) * g.ny + g.col0 + j;
+                exchange(&g, f, s, &ex);
+                long errors = check_ghosts(&g, f), total_errors;
+                MPI_Reduce(&errors, &total_errors, 1, MPI_LONG, MPI_SUM, root,
+                           g.cart);
+
+                for (int r = 0; r < 5; ++r) exchange(&g, f, s, &ex);
+                MPI_Barrier(g.cart);
+                double start = MPI_Wtime();
+                for (long r = 0; r < reps; ++r) exchange(&g, f, s, &ex);
+                double elapsed = MPI_Wtime() - start, slowest;
+                MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, root,
+                           g.cart);
+                exchange_free(s, &ex);
+
+                if (rank == root) {
+                    double us = slowest / reps * 1e6;
+                    printf("%s,%d,%d,%.0f,%.3f,%.1f\n", strategy_names[s], w,
+                           n, bytes, us, us > 0 ? bytes / us : 0.0);
+                    if (total_errors) {
+                        printf("! %s found %ld wrong ghost cells\n",
+                               strategy_names[s], total_errors);
+                        status = 1;
+                    }
+                    if (best_strategy < 0 || us < best) {
+                        best = us;
+                        best_strategy = s;
+                    }
+                }
+            }
+            if (rank == root) {
+                printf("# fastest for width %d block %d: %s\n", w, n,
+                       strategy_names[best_strategy]);
+                fflush(stdout);
+            }
+            free(f);
+            halo_grid_free(&g);
+        }
+    }
+    MPI_Bcast(&status, 1, MPI_INT, root, MPI_COMM_WORLD);
+    MPI_Finalize();
+    return status;
+}
+
+int parse_list(const char* arg, int* out, int max) {
+    // comma separated positive ints, count back or 0 if malformed
+    int count = 0;
+    const char* p = arg;
+    char* end;
+    for (;;) {
+        long v = strtol(p, &end, 10);
+        if (end == p || v < 1 || count == max) return 0;
+        out[count++] = (int)v;
+        if (*end != ',') return *end ? 0 : count;
+        p = end + 1;
+    }
+}
+
+int exchange_setup(HaloGrid* g, double* f, int s, Exchange* ex) {
+    // 1 if this MPI can't do the strategy
+    int k = g->ghost;
+    if (s == PERSISTENT) {
+        // same 8 transfers as halo_start, built once and restarted
+        MPI_Recv_init(&HALO_AT(g, f, -k, 0), 1, g->row_type, g->up,
+                      HALO_TAG_DOWN, g->cart, &ex->persistent[0]);
+        MPI_Recv_init(&HALO_AT(g, f, g->rows, 0), 1, g->row_type, g->down,
+                      HALO_TAG_UP, g->cart, &ex->persistent[1]);
+        MPI_Recv_init(&HALO_AT(g, f, 0, -k), 1, g->col_type, g->left,
+                      HALO_TAG_RIGHT, g->cart, &ex->persistent[2]);
+        MPI_Recv_init(&HALO_AT(g, f, 0, g->cols), 1, g->col_type, g->right,
+                      HALO_TAG_LEFT, g->cart, &ex->persistent[3]);
+        MPI_Send_init(&HALO_AT(g, f, 0, 0), 1, g->row_type, g->up,
+                      HALO_TAG_UP, g->cart, &ex->persistent[4]);
+        MPI_Send_init(&HALO_AT(g, f, g->rows - k, 0), 1, g->row_type,
+                      g->down, HALO_TAG_DOWN, g->cart, &ex->persistent[5]);
+        MPI_Send_init(&HALO_AT(g, f, 0, 0), 1, g->col_type, g->left,
+                      HALO_TAG_LEFT, g->cart, &ex->persistent[6]);
+        MPI_Send_init(&HALO_AT(g, f, 0, g->cols - k), 1, g->col_type,
+                      g->right, HALO_TAG_RIGHT, g->cart, &ex->persistent[7]);
+    } else if (s == NEIGHBOR) {
+        // cartesian neighbour order is up, down, left, right, rows and
+        // columns need different types so it's the w variant of alltoall
+        // on a copy of the communicator, collectives and the point to point
+        // strategies shouldn't share one
+        MPI_Comm_dup(g->cart, &ex->neighbor_comm);
+        double* send[4] = {
+            &HALO_AT(g, f, 0, 0), &HALO_AT(g, f, g->rows - k, 0),
+            &HALO_AT(g, f, 0, 0), &HALO_AT(g, f, 0, g->cols - k)};
+        double* recv[4] = {
+            &HALO_AT(g, f, -k, 0), &HALO_AT(g, f, g->rows, 0),
+            &HALO_AT(g, f, 0, -k), &HALO_AT(g, f, 0, g->cols)};
+        ex->types[0] = ex->types[1] = g->row_type;
+        ex->types[2] = ex->types[3] = g->col_type;
+        for (int i = 0; i < 4; ++i) {
+            ex->counts[i] = 1;
+            ex->send_displs[i] = (char*)send[i] - (char*)f;
+            ex->recv_displs[i] = (char*)recv[i] - (char*)f;
+        }
+    } else if (s == PUT) {
+        // whole field exposed, every block has the same shape so our
+        // offsets are the neighbours' offsets too
+        // open mpi has no one sided component for a lone rank without ucx
+        MPI_Comm_set_errhandler(g->cart, MPI_ERRORS_RETURN);
+        int err = MPI_Win_create(
+            f, (MPI_Aint)(g->rows + 2 * k) * g->stride * sizeof(double),
+            sizeof(double), MPI_INFO_NULL, g->cart, &ex->win);
+        MPI_Comm_set_errhandler(g->cart, MPI_ERRORS_ARE_FATAL);
+        return err != MPI_SUCCESS;
+    }
+    return 0;
+}
+
+void exchange_free(int s, Exchange* ex) {
+    if (s == PERSISTENT)
+        for (int i = 0; i < 8; ++i) MPI_Request_free(&ex->persistent[i]);
+    else if (s == NEIGHBOR)
+        MPI_Comm_free(&ex->neighbor_comm);
+    else if (s == PUT)
+        MPI_Win_free(&ex->win);
+}
+
+void exchange(HaloGrid* g, double* f, int s, Exchange* ex) {
+    int k = g->ghost;
+    switch (s) {
+        case ISEND:
+            halo_exchange(g, f);
+            break;
+        case SENDRECV:
+            // each direction pairs a send one way with a receive the other
+            MPI_Sendrecv(&HALO_AT(g, f, 0, 0), 1, g->row_type, g->up,
+                         HALO_TAG_UP, &HALO_AT(g, f, g->rows, 0), 1,
+                         g->row_type, g->down, HALO_TAG_UP, g->cart,
+                         MPI_STATUS_IGNORE);
+            MPI_Sendrecv(&HALO_AT(g, f, g->rows - k, 0), 1, g->row_type,
+                         g->down, HALO_TAG_DOWN, &HALO_AT(g, f, -k, 0), 1,
+                         g->row_type, g->up, HALO_TAG_DOWN, g->cart,
+                         MPI_STATUS_IGNORE);
+            MPI_Sendrecv(&HALO_AT(g, f, 0, 0), 1, g->col_type, g->left,
+                         HALO_TAG_LEFT, &HALO_AT(g, f, 0, g->cols), 1,
+                         g->col_type, g->right, HALO_TAG_LEFT, g->cart,
+                         MPI_STATUS_IGNORE);
+            MPI_Sendrecv(&HALO_AT(g, f, 0, g->cols - k), 1, g->col_type,
+                         g->right, HALO_TAG_RIGHT, &HALO_AT(g, f, 0, -k), 1,
+                         g->col_type, g->left, HALO_TAG_RIGHT, g->cart,
+                         MPI_STATUS_IGNORE);
+            break;
+        case PERSISTENT:
+            MPI_Startall(8, ex->persistent);
+            MPI_Waitall(8, ex->persistent, MPI_STATUSES_IGNORE);
+            break;
+        case NEIGHBOR:
+            MPI_Neighbor_alltoallw(f, ex->counts, ex->send_displs, ex->types,
+                                   f, ex->counts, ex->recv_displs, ex->types,
+                                   ex->neighbor_comm);
+            break;
+        case PUT: {
+            // our edge goes straight into the neighbour's facing ghosts
+            MPI_Aint top = &HALO_AT(g, f, -k, 0) - f;
+            MPI_Aint bottom = &HALO_AT(g, f, g->rows, 0) - f;
+            MPI_Aint left = &HALO_AT(g, f, 0, -k) - f;
+            MPI_Aint right = &HALO_AT(g, f, 0, g->cols) - f;
+            MPI_Win_fence(MPI_MODE_NOPRECEDE, ex->win);
+            if (g->up != MPI_PROC_NULL)
+                MPI_Put(&HALO_AT(g, f, 0, 0), 1, g->row_type, g->up, bottom,
+                        1, g->row_type, ex->win);
+            if (g->down != MPI_PROC_NULL)
+                MPI_Put(&HALO_AT(g, f, g->rows - k, 0), 1, g->row_type,
+                        g->down, top, 1, g->row_type, ex->win);
+            if (g->left != MPI_PROC_NULL)
+                MPI_Put(&HALO_AT(g, f, 0, 0), 1, g->col_type, g->left, right,
+                        1, g->col_type, ex->win);
+            if (g->right != MPI_PROC_NULL)
+                MPI_Put(&HALO_AT(g, f, 0, g->cols - k), 1, g->col_type,
+                        g->right, left, 1, g->col_type, ex->win);
+            MPI_Win_fence(MPI_MODE_NOSTORE | MPI_MODE_NOSUCCEED, ex->win);
+            break;
+        }
+    }
+}
+
+long check_ghosts(const HaloGrid* g, const double* f) {
+    // ghost cells beside the block, corners aren't exchanged
+    long errors = 0;
+    int k = g->ghost;
+    for (int i = -k; i < g->rows + k; ++i)
+        for (int j = -k; j < g->cols + k; ++j) {
+            int row_ghost = i < 0 || i >= g->rows;
+            int col_ghost = j < 0 || j >= g->cols;
+            if (row_ghost == col_ghost) continue;
+            int gi = g->row0 + i, gj = g->col0 + j;
+            double expected = gi < 0 || gj < 0 || gi >= g->nx || gj >= g->ny
+                                  ? -1.0
+                                  : (double)gi * g->ny + gj;
+            if (HALO_AT(g, f, i, j) != expected) ++errors;
+        }
+    return errors;
+}
@@ -0,0 +1,267 @@
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "halo.h"
+
+// temperature held along the top edge, the other edges are held at 0
+#define HOT_EDGE 100.0
+
+double sweep(const HaloGrid*, const double*, double*, int, int, int, int);
+double cell_time(int, int);
+
+int main(int argc, char* argv[]) {
+    int rank, size;
+    const int root = 0;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // -i = max iterations
+    // -e = stop once no cell changes by more than this in an iteration
+    // -c = iterations between convergence checks, each is an allreduce
+    // -s = exchange halos before computing instead of overlapping them
+    // -k = ghost width, k sweeps per exchange with the cells near the edge
+    //      computed on both sides of it
+    // -a = let halo_tune pick the ghost width, up to -k if given, else 8
+    long max_iters = 1000, check = 10, ghost = 0;
+    double tol = 0;
+    int overlap = 1, tune = 0, opt, failed = 0;
+    char* ptr;
+    while (!failed && (opt = getopt(argc, argv, "i:e:c:sk:a")) != -1) {
+        switch (opt) {
+            case 'i':
+                max_iters = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || max_iters < 1;
+                break;
+            case 'e':
+                tol = strtod(optarg, &ptr);
+                failed = ptr == optarg;
+                break;
+            case 'c':
+                check = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || check < 1;
+                break;
+            case 's':
+                overlap = 0;
+                break;
+            case 'k':
+                ghost = strtol(optarg, &ptr, 10);
+                failed = ptr == optarg || ghost < 1;
+                break;
+            case 'a':
+                tune = 1;
+                break;
+            default:
+                failed = 1;
+        }
+    }
+    // nx x ny interior cells
+    long nx = 0, ny = 0;
+    if (!failed && argc - optind == 2) {
+        nx = strtol(argv[optind], &ptr, 10);
+        failed = ptr == argv[optind] || nx < 1;
+        ny = strtol(argv[optind + 1], &ptr, 10);
+        failed = failed || ptr == argv[optind + 1] || ny < 1;
+    } else {
+        failed = 1;
+    }
+    if (failed) {
+        if (rank == root)
+            printf("Usage: %s [-i iterations] [-e tol] [-c check] [-s] "
+                   "[-k ghost] [-a] nx ny\n",
+                   argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (tune) {
+        double tune_start = MPI_Wtime();
+        HaloTuning tuning;
+        double per_cell = cell_time((int)nx, (int)ny);
+        if (per_cell < 0 ||
+            halo_tune(MPI_COMM_WORLD, (int)nx, (int)ny, ghost ? ghost : 8,
+                      per_cell, &tuning)) {
+            if (rank == root) printf("Grid too small for %d ranks\n", size);
+            MPI_Finalize();
+            return 1;
+        }
+        ghost = tuning.ghost;
+        if (rank == root) {
+            printf("Latency: %.2f us, bandwidth: %.1f MB/s, "
+                   "cell update: %.2f ns\n",
+                   tuning.latency * 1e6, tuning.bandwidth / 1e6,
+                   tuning.cell_time * 1e9);
+            printf("Ghost width %ld, predicted %.2f us per iteration\n", ghost,
+                   tuning.predicted * 1e6);
+            printf("Tuning time (s): %lf\n", MPI_Wtime() - tune_start);
+        }
+    }
+    if (!ghost) ghost = 1;
+
+    HaloGrid g;
+    if (halo_grid_init(&g, MPI_COMM_WORLD, (int)nx, (int)ny, (int)ghost)) {
+        if (rank == root)
+            printf("Grid too small for %d ranks with ghost width %ld\n", size,
+                   ghost);
+        MPI_Finalize();
+        return 1;
+    }
+    double* old = halo_field_alloc(&g);
+    double* new = halo_field_alloc(&g);
+    if (!old || !new) {
+        printf("Could not malloc\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // fixed boundary lives in the ghost row above the top block row, in both
+    // fields since they swap every iteration, and out into the ghost
+    // columns that deeper halos compute into
+    if (g.up == MPI_PROC_NULL)
+        for (int j = -g.ghost; j < g.cols + g.ghost; ++j)
+            HALO_AT(&g, old, -1, j) = HALO_AT(&g, new, -1, j) = HOT_EDGE;
+
+    if (rank == root) {
+        if (ghost > 1)
+            printf("%ld x %ld grid on %d x %d ranks, ghost width %ld\n", nx,
+                   ny, g.dims[0], g.dims[1], ghost);
+        else
+            printf("%ld x %ld grid on %d x %d ranks, %s exchange\n", nx, ny,
+                   g.dims[0], g.dims[1], overlap ? "overlapped" : "blocking");
+        fflush(stdout);
+    }
+
+    MPI_Barrier(g.cart);
+    double start = MPI_Wtime(), exchange_time = 0, t;
+    double diff = INFINITY;
+    long iters = 0;
+    int rows = g.rows, cols = g.cols;
+    while (iters < max_iters) {
+        double local_diff, edge_diff;
+        long steps = ghost < max_iters - iters ? ghost : max_iters - iters;
+        if (ghost > 1) {
+            // one exchange buys ghost sweeps, each over a region a cell
+            // smaller all round, ending on just the block
+            t = MPI_Wtime();
+            halo_exchange_full(&g, old);
+            exchange_time += MPI_Wtime() - t;
+            for (int step = 0; step < steps; ++step) {
+                int ext[4];
+                halo_depth_extent(&g, step, ext);
+                local_diff = sweep(&g, old, new, -ext[0], rows + ext[1],
+                                   -ext[2], cols + ext[3]);
+                double* tmp = old;
+                old = new;
+                new = tmp;
+            }
+        } else {
+            if (overlap) {
+                // cells that don't touch a ghost go while the halos are in
+                // flight
+                t = MPI_Wtime();
+                halo_start(&g, old);
+                exchange_time += MPI_Wtime() - t;
+                local_diff = sweep(&g, old, new, 1, rows - 1, 1, cols - 1);
+                t = MPI_Wtime();
+                halo_finish(&g);
+                exchange_time += MPI_Wtime() - t;
+            } else {
+                t = MPI_Wtime();
+                halo_exchange(&g, old);
+                exchange_time += MPI_Wtime() - t;
+                local_diff = sweep(&g, old, new, 1, rows - 1, 1, cols - 1);
+            }
+            // then the outer ring, top and bottom rows whole, sides in
+            // between
+            edge_diff = sweep(&g, old, new, 0, 1, 0, cols);
+            if (edge_diff > local_diff) local_diff = edge_diff;
+            if (rows > 1) {
+                edge_diff = sweep(&g, old, new, rows - 1, rows, 0, cols);
+                if (edge_diff > local_diff) local_diff = edge_diff;
+            }
+            edge_diff = sweep(&g, old, new, 1, rows - 1, 0, 1);
+            if (edge_diff > local_diff) local_diff = edge_diff;
+            if (cols > 1) {
+                edge_diff = sweep(&g, old, new, 1, rows - 1, cols - 1, cols);
+                if (edge_diff > local_diff) local_diff = edge_diff;
+            }
+            double* tmp = old;
+            old = new;
+            new = tmp;
+        }
+
+        long before = iters;
+        iters += steps;
+        if (iters / check != before / check || iters == max_iters) {
+            MPI_Allreduce(&local_diff, &diff, 1, MPI_DOUBLE, MPI_MAX, g.cart);
+            if (diff <= tol) break;
+        }
+    }
+    double elapsed = MPI_Wtime() - start;
+
+    // sum of every cell, the same whatever the decomposition give or take
+    // the order of the additions
+    double local_sum = 0, sum = 0, max_exchange = 0;
+    for (int i = 0; i < rows; ++i)
+        for (int j = 0; j < cols; ++j) local_sum += HALO_AT(&g, old, i, j);
+    MPI_Reduce(&local_sum, &sum, 1, MPI_DOUBLE, MPI_SUM, root, g.cart);
+    MPI_Reduce(&exchange_time, &max_exchange, 1, MPI_DOUBLE, MPI_MAX, root,
+               g.cart);
+
+    if (rank == root) {
+        printf("Iterations: %ld, last change: %.3e\n", iters, diff);
+        printf("Checksum: %.12e\n", sum);
+        printf("Exchange time (s): %lf\n", max_exchange);
+        printf("Overall time (s): %lf\n", elapsed);
+        printf("Updates per second: %.3e\n",
+               elapsed > 0 ? (double)nx * ny * iters / elapsed : 0.0);
+        fflush(stdout);
+    }
+
+    free(old);
+    free(new);
+    halo_grid_free(&g);
+    MPI_Finalize();
+    return 0;
+}
+
+double sweep(const HaloGrid* g, const double* old, double* new, int i0,
+             int i1, int j0, int j1) {
+    // jacobi update of rows [i0, i1) x cols [j0, j1), largest change back
+    double diff = 0;
+    for (int i = i0; i < i1; ++i)
+        for (int j = j0; j < j1; ++j) {
+            double v = 0.25 * (HALO_AT(g, old, i - 1, j) +
+                               HALO_AT(g, old, i + 1, j) +
+                               HALO_AT(g, old, i, j - 1) +
+                               HALO_AT(g, old, i, j + 1));
+            double d = fabs(v - HALO_AT(g, old, i, j));
+            if (d > diff) diff = d;
+            HALO_AT(g, new, i, j) = v;
+        }
+    return diff;
+}
+
+double cell_time(int nx, int ny) {
+    // seconds per cell update on the slowest rank, for halo_tune
+    // collective, -1 if the grid is too small to split between the ranks
+    HaloGrid g;
+    if (halo_grid_init(&g, MPI_COMM_WORLD, nx, ny, 1)) return -1;
+    double* a = halo_field_alloc(&g);
+    double* b = halo_field_alloc(&g);
+    if (!a || !b) {
+        printf("Could not malloc\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    const int reps = 5;
+    sweep(&g, a, b, 0, g.rows, 0, g.cols);
+    double start = MPI_Wtime();
+    for (int r = 0; r < reps; ++r) sweep(&g, b, a, 0, g.rows, 0, g.cols);
+    double per_cell = (MPI_Wtime() - start) / reps / g.rows / g.cols, slowest;
+    MPI_Allreduce(&per_cell, &slowest, 1, MPI_DOUBLE, MPI_MAX, g.cart);
+    free(a);
+    free(b);
+    halo_grid_free(&g);
+    return slowest;
+}
@@ -12,20 +12,16 @@
 #include <string.h>
 #include <time.h>
 
+#include "primality.h"
+
 #define SHIFT_ROW 0
 #define SHIFT_COL 1
 #define DISP 1
 #define UPPER_BOUND 100
 
-int is_prime(int i) {
-    int l = (int)ceil(sqrt((double)i));
-    for (int j = 2; j <= l; ++j)
-        if (i % j == 0) return 0;  // found a divisor, not prime
-    return 1;                      // no divisors, is prime
-}
-
 int gen_rand_prime() {
     int i;
+    // shared primality check answers these from a table lookup
     while (!is_prime(i = rand() % (UPPER_BOUND + 1)))
         ;
     return i;
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+
+#include "logship.h"
+
 int master_io(MPI_Comm master_comm, MPI_Comm comm);
 int slave_io(MPI_Comm master_comm, MPI_Comm comm);
 int main(int argc, char **argv) {
@@ -19,26 +22,31 @@ int main(int argc, char **argv) {
 }
 /* This is the master */
 int master_io(MPI_Comm master_comm, MPI_Comm comm) {
-    int i, j, size;
-    char buf[256];
-    MPI_Status status;
+    // slaves' lines come in frames from whichever slave is ready, they're
+    // still printed a line per slave per round, the slaves are ranks 1 on
+    int size;
     MPI_Comm_size(master_comm, &size);
-    for (j = 1; j <= 2; j++) {
-        for (i = 1; i < size; i++) {
-            MPI_Recv(buf, 256, MPI_CHAR, i, 0, master_comm, &status);
-            fputs(buf, stdout);
-        }
+    if (logship_print_ordered(master_comm, 1, size - 1, 0, "")) {
+        printf("Could not malloc\n");
+        MPI_Abort(master_comm, 1);
     }
     return 0;
 }
 /* This is the slave */
 int slave_io(MPI_Comm master_comm, MPI_Comm comm) {
-    char buf[256];
     int rank;
+    LogShipper log;
     MPI_Comm_rank(comm, &rank);
-    sprintf(buf, "Hello from slave %d\n", rank);
-    MPI_Send(buf, strlen(buf) + 1, MPI_CHAR, 0, 0, master_comm);
-    sprintf(buf, "Goodbye from slave %d\n", rank);
-    MPI_Send(buf, strlen(buf) + 1, MPI_CHAR, 0, 0, master_comm);
+    if (logship_open(&log, master_comm, 0, LOGSHIP_FRAME_SIZE,
+                     LOGSHIP_DELAY)) {
+        printf("Could not malloc\n");
+        MPI_Abort(master_comm, 1);
+    }
+    if (logship_printf(&log, 0, "Hello from slave %d\n", rank) ||
+        logship_printf(&log, 0, "Goodbye from slave %d\n", rank)) {
+        printf("Could not malloc\n");
+        MPI_Abort(master_comm, 1);
+    }
+    logship_close(&log);
     return 0;
 }
@@ -0,0 +1,251 @@
+#include "logship.h"
+
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "reorder.h"
+
+static void put_header(char* at, int kind, size_t len) {
+    uint32_t n = (uint32_t)len;
+    memcpy(at, &n, 4);
+    at[4] = (char)kind;
+}
+
+int logship_open(LogShipper* ls, MPI_Comm comm, int dest, size_t frame_size,
+                 double max_delay) {
+    // 1 if out of memory
+    if (frame_size < LOGSHIP_HEADER + 1) frame_size = LOGSHIP_HEADER + 1;
+    ls->frames[0] = (char*)malloc(frame_size);
+    ls->frames[1] = (char*)malloc(frame_size);
+    if (!ls->frames[0] || !ls->frames[1]) {
+        free(ls->frames[0]);
+        free(ls->frames[1]);
+        return 1;
+    }
+    ls->comm = comm;
+    ls->dest = dest;
+    ls->active = 0;
+    ls->used = 0;
+    ls->capacity = frame_size;
+    ls->in_flight = 0;
+    ls->max_delay = max_delay;
+    ls->oldest = 0;
+    ls->lines = 0;
+    ls->frames_sent = 0;
+    return 0;
+}
+
+void logship_flush(LogShipper* ls) {
+    // send the active frame and start filling the other one, which has to
+    // wait for its last send to finish first
+    if (!ls->used) return;
+    if (ls->in_flight) MPI_Wait(&ls->req, MPI_STATUS_IGNORE);
+    MPI_Isend(ls->frames[ls->active], (int)ls->used, MPI_BYTE, ls->dest,
+              LOGSHIP_FRAME_TAG, ls->comm, &ls->req);
+    ls->in_flight = 1;
+    ++ls->frames_sent;
+    ls->active = !ls->active;
+    ls->used = 0;
+}
+
+void logship_poll(LogShipper* ls) {
+    // for senders that go quiet for a while, sends the frame if it's due
+    if (ls->used && MPI_Wtime() - ls->oldest >= ls->max_delay)
+        logship_flush(ls);
+}
+
+static void logship_added(LogShipper* ls, size_t len) {
+    // a record of len text bytes has just been put in the active frame
+    if (!ls->used) ls->oldest = MPI_Wtime();
+    ls->used += LOGSHIP_HEADER + len;
+    ++ls->lines;
+    logship_poll(ls);
+}
+
+static int logship_send_alone(LogShipper* ls, int kind, const char* text,
+                              size_t len) {
+    // a line bigger than a whole frame goes out in a frame of its own
+    char* frame = (char*)malloc(LOGSHIP_HEADER + len);
+    if (!frame) return 1;
+    put_header(frame, kind, len);
+    memcpy(frame + LOGSHIP_HEADER, text, len);
+    if (ls->in_flight) MPI_Wait(&ls->req, MPI_STATUS_IGNORE);
+    ls->in_flight = 0;
+    MPI_Send(frame, (int)(LOGSHIP_HEADER + len), MPI_BYTE, ls->dest,
+             LOGSHIP_FRAME_TAG, ls->comm);
+    ++ls->frames_sent;
+    ++ls->lines;
+    free(frame);
+    return 0;
+}
+
+int logship_write(LogShipper* ls, int kind, const char* text, size_t len) {
+    // adds len bytes of text as one line, 1 if out of memory
+    if (LOGSHIP_HEADER + len > ls->capacity - ls->used) logship_flush(ls);
+    if (LOGSHIP_HEADER + len > ls->capacity)
+        return logship_send_alone(ls, kind, text, len);
+    char* at = ls->frames[ls->active] + ls->used;
+    put_header(at, kind, len);
+    memcpy(at + LOGSHIP_HEADER, text, len);
+    logship_added(ls, len);
+    return 0;
+}
+
+int logship_vprintf(LogShipper* ls, int kind, const char* fmt, va_list ap) {
+    // formats straight into the frame when it fits, 1 on failure
+    va_list again;
+    va_copy(again, ap);
+    size_t room = ls->capacity - ls->used;
+    char* at = ls->frames[ls->active] + ls->used;
+    int len = room > LOGSHIP_HEADER
+                  ? vsnprintf(at + LOGSHIP_HEADER, room - LOGSHIP_HEADER, fmt,
+                              ap)
+                  : vsnprintf(NULL, 0, fmt, ap);
+    int failed = len < 0;
+    if (!failed && LOGSHIP_HEADER + (size_t)len < room) {
+        // vsnprintf's terminator isn't part of the record
+        put_header(at, kind, len);
+        logship_added(ls, len);
+    } else if (!failed) {
+        char* text = (char*)malloc((size_t)len + 1);
+        failed = !text;
+        if (!failed) {
+            vsnprintf(text, (size_t)len + 1, fmt, again);
+            failed = logship_write(ls, kind, text, len);
+            free(text);
+        }
+    }
+    va_end(again);
+    return failed;
+}
+
+int logship_printf(LogShipper* ls, int kind, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int failed = logship_vprintf(ls, kind, fmt, ap);
+    va_end(ap);
+    return failed;
+}
+
+void logship_close(LogShipper* ls) {
+    // sends what's left then the empty frame that tells dest we're done
+    logship_flush(ls);
+    if (ls->in_flight) MPI_Wait(&ls->req, MPI_STATUS_IGNORE);
+    ls->in_flight = 0;
+    MPI_Send(ls->frames[0], 0, MPI_BYTE, ls->dest, LOGSHIP_FRAME_TAG,
+             ls->comm);
+    free(ls->frames[0]);
+    free(ls->frames[1]);
+}
+
+int logship_collector_init(LogCollector* lc, MPI_Comm comm, int senders) {
+    // 1 if out of memory
+    lc->frame = (char*)malloc(LOGSHIP_FRAME_SIZE);
+    if (!lc->frame) return 1;
+    lc->comm = comm;
+    lc->capacity = LOGSHIP_FRAME_SIZE;
+    lc->open = senders;
+    lc->lines = 0;
+    lc->frames = 0;
+    return 0;
+}
+
+int logship_collect(LogCollector* lc, LogLineFn fn, void* arg) {
+    // waits for one frame from any sender and hands fn each line in it,
+    // the text isn't terminated, 1 if out of memory
+    MPI_Status status;
+    int count;
+    MPI_Probe(MPI_ANY_SOURCE, LOGSHIP_FRAME_TAG, lc->comm, &status);
+    MPI_Get_count(&status, MPI_BYTE, &count);
+    if ((size_t)count > lc->capacity) {
+        char* frame = (char*)realloc(lc->frame, count);
+        if (!frame) return 1;
+        lc->frame = frame;
+        lc->capacity = count;
+    }
+    MPI_Recv(lc->frame, count, MPI_BYTE, status.MPI_SOURCE, LOGSHIP_FRAME_TAG,
+             lc->comm, MPI_STATUS_IGNORE);
+    ++lc->frames;
+    if (!count) {
+        --lc->open;
+        fn(status.MPI_SOURCE, LOGSHIP_EOF, NULL, 0, arg);
+        return 0;
+    }
+    for (size_t at = 0; at + LOGSHIP_HEADER <= (size_t)count;) {
+        uint32_t len;
+        memcpy(&len, lc->frame + at, 4);
+        int kind = lc->frame[at + 4];
+        fn(status.MPI_SOURCE, kind, lc->frame + at + LOGSHIP_HEADER, len, arg);
+        at += LOGSHIP_HEADER + len;
+        ++lc->lines;
+    }
+    return 0;
+}
+
+int logship_pending(LogCollector* lc) {
+    // whether a frame is already waiting, callers flush their output when
+    // there isn't one
+    int flag;
+    MPI_Iprobe(MPI_ANY_SOURCE, LOGSHIP_FRAME_TAG, lc->comm, &flag,
+               MPI_STATUS_IGNORE);
+    return flag;
+}
+
+void logship_collector_free(LogCollector* lc) { free(lc->frame); }
+
+typedef struct {
+    ReorderBuffer rb;
+    int first;  // sender rank that is reorder buffer rank 0
+    int ordered;
+    const char* prefix;
+    int failed;
+} LogPrinter;
+
+static void print_line(const char* text, void* arg) {
+    // stdout is fully buffered, flushed whenever the collector goes idle
+    fputs((const char*)arg, stdout);
+    fputs(text, stdout);
+}
+
+static void print_or_park(int source, int kind, const char* text, size_t len,
+                          void* arg) {
+    LogPrinter* lp = (LogPrinter*)arg;
+    if (kind == LOGSHIP_EOF) {
+        reorder_exit(&lp->rb, source - lp->first);
+    } else if (kind != lp->ordered) {
+        fputs(lp->prefix, stdout);
+        fwrite(text, 1, len, stdout);
+    } else if (reorder_push(&lp->rb, source - lp->first, text, len)) {
+        lp->failed = 1;
+    }
+}
+
+int logship_print_ordered(MPI_Comm comm, int first, int senders, int ordered,
+                          const char* prefix) {
+    // ordered lines that come in ahead of their turn wait in a reorder
+    // buffer rather than the collector blocking on the sender whose turn it
+    // is, 1 if out of memory
+    LogPrinter lp;
+    LogCollector lc;
+    lp.first = first;
+    lp.ordered = ordered;
+    lp.prefix = prefix;
+    lp.failed = 0;
+    if (reorder_init(&lp.rb, senders, print_line, (void*)prefix)) return 1;
+    if (logship_collector_init(&lc, comm, senders)) {
+        reorder_free(&lp.rb);
+        return 1;
+    }
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    while (lc.open && !lp.failed) {
+        lp.failed = logship_collect(&lc, print_or_park, &lp) || lp.failed;
+        if (!logship_pending(&lc)) fflush(stdout);
+    }
+    fflush(stdout);
+    logship_collector_free(&lc);
+    reorder_free(&lp.rb);
+    return lp.failed;
+}
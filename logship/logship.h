@@ -0,0 +1,70 @@
+#ifndef LOGSHIP_H_INCLUDED
+#define LOGSHIP_H_INCLUDED
+
+#include <mpi.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#define LOGSHIP_FRAME_TAG 110
+
+// default frame size and how long a line may sit in one before it's sent
+#define LOGSHIP_FRAME_SIZE 65536
+#define LOGSHIP_DELAY 0.05
+
+// kind handed to the collector's callback once a sender has closed
+#define LOGSHIP_EOF (-1)
+
+// a frame is a run of records, each a 4 byte length, a 1 byte kind the
+// caller picks and the text, an empty frame means the sender is done
+#define LOGSHIP_HEADER 5
+
+// sender side, lines are packed into a frame that goes out once the next
+// line wouldn't fit or the oldest line in it is older than max_delay
+// the deadline is only looked at when a line is added or on logship_poll
+// two frames so one can fill while the other is in flight
+typedef struct {
+    MPI_Comm comm;
+    int dest;
+    char* frames[2];
+    int active;  // frame being filled
+    size_t used;
+    size_t capacity;
+    MPI_Request req;  // send of the other frame
+    int in_flight;
+    double max_delay;
+    double oldest;  // when the first line in the active frame was added
+    long lines;
+    long frames_sent;
+} LogShipper;
+
+// receiver side, frames from any sender in the order they arrive
+typedef struct {
+    MPI_Comm comm;
+    char* frame;
+    size_t capacity;
+    int open;  // senders yet to close
+    long lines;
+    long frames;
+} LogCollector;
+
+typedef void (*LogLineFn)(int, int, const char*, size_t, void*);
+
+int logship_open(LogShipper*, MPI_Comm, int, size_t, double);
+int logship_write(LogShipper*, int, const char*, size_t);
+int logship_printf(LogShipper*, int, const char*, ...);
+int logship_vprintf(LogShipper*, int, const char*, va_list);
+void logship_poll(LogShipper*);
+void logship_flush(LogShipper*);
+void logship_close(LogShipper*);
+
+int logship_collector_init(LogCollector*, MPI_Comm, int);
+int logship_collect(LogCollector*, LogLineFn, void*);
+int logship_pending(LogCollector*);
+void logship_collector_free(LogCollector*);
+
+// collects until every sender has closed and prints to stdout, lines of the
+// ordered kind a line per sender per round in rank order, anything else as
+// soon as it arrives, each after prefix, senders are ranks first on
+int logship_print_ordered(MPI_Comm, int, int, int, const char*);
+
+#endif
@@ -0,0 +1,74 @@
+#include "reorder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int reorder_init(ReorderBuffer* rb, int ranks,
+                 void (*emit)(const char*, void*), void* arg) {
+    rb->queues = (ReorderQueue*)calloc(ranks, sizeof(*rb->queues));
+    if (!rb->queues) return 1;
+    rb->ranks = ranks;
+    rb->next = 0;
+    rb->parked = rb->max_parked = 0;
+    rb->emit = emit;
+    rb->arg = arg;
+    return 0;
+}
+
+static void reorder_drain(ReorderBuffer* rb) {
+    // print from the head of the round for as long as lines are there,
+    // ranks that have exited drop out of the rotation
+    for (int skipped = 0; skipped < rb->ranks;) {
+        ReorderQueue* q = &rb->queues[rb->next];
+        if (q->head) {
+            ReorderLine* line = q->head;
+            q->head = line->next;
+            if (!q->head) q->tail = NULL;
+            --rb->parked;
+            rb->emit(line->text, rb->arg);
+            free(line);
+            skipped = 0;
+        } else if (q->exited) {
+            ++skipped;
+        } else {
+            return;
+        }
+        rb->next = (rb->next + 1) % rb->ranks;
+    }
+}
+
+int reorder_push(ReorderBuffer* rb, int rank, const char* text, size_t len) {
+    // text need not be terminated, 1 if out of memory
+    ReorderLine* line = (ReorderLine*)malloc(sizeof(*line) + len + 1);
+    if (!line) return 1;
+    memcpy(line->text, text, len);
+    line->text[len] = '\0';
+    line->next = NULL;
+    ReorderQueue* q = &rb->queues[rank];
+    if (q->tail)
+        q->tail->next = line;
+    else
+        q->head = line;
+    q->tail = line;
+    ++rb->parked;
+    reorder_drain(rb);
+    if (rb->parked > rb->max_parked) rb->max_parked = rb->parked;
+    return 0;
+}
+
+void reorder_exit(ReorderBuffer* rb, int rank) {
+    rb->queues[rank].exited = 1;
+    reorder_drain(rb);
+}
+
+void reorder_free(ReorderBuffer* rb) {
+    for (int i = 0; i < rb->ranks; ++i) {
+        ReorderLine* line = rb->queues[i].head;
+        while (line) {
+            ReorderLine* next = line->next;
+            free(line);
+            line = next;
+        }
+    }
+    free(rb->queues);
+}
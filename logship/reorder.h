@@ -0,0 +1,36 @@
+#ifndef REORDER_H_INCLUDED
+#define REORDER_H_INCLUDED
+
+#include <stddef.h>
+
+typedef struct ReorderLine {
+    struct ReorderLine* next;
+    char text[];
+} ReorderLine;
+
+typedef struct {
+    ReorderLine* head;
+    ReorderLine* tail;
+    int exited;  // no more lines coming
+} ReorderQueue;
+
+// ordered lines go out one per rank per round, rank 0 first
+// lines that arrive early wait in their rank's queue, every line that
+// can go out does as soon as it arrives, so one slow rank only holds up
+// the lines that have to come after its own
+typedef struct {
+    int ranks;
+    int next;  // rank whose line goes out next
+    ReorderQueue* queues;
+    long parked;  // lines waiting right now
+    long max_parked;
+    void (*emit)(const char*, void*);
+    void* arg;
+} ReorderBuffer;
+
+int reorder_init(ReorderBuffer*, int, void (*)(const char*, void*), void*);
+int reorder_push(ReorderBuffer*, int, const char*, size_t);
+void reorder_exit(ReorderBuffer*, int);
+void reorder_free(ReorderBuffer*);
+
+#endif
@@ -0,0 +1,242 @@
+#include "archive.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const unsigned char* read_varint(const unsigned char* p, uint64_t* v) {
+    // 7 bits per byte, low bits first, top bit set means more follow
+    uint64_t result = 0;
+    int shift = 0;
+    while (*p & 0x80) {
+        result |= (uint64_t)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    *v = result | ((uint64_t)*p++ << shift);
+    return p;
+}
+
+static uint64_t next_prime(uint64_t prev, uint64_t half_gap) {
+    // only gap that isn't even is 2 -> 3
+    return prev == 2 ? 3 : prev + 2 * half_gap;
+}
+
+int archive_writer_open(ArchiveWriter* w, const char* filename) {
+    memset(w, 0, sizeof(*w));
+    w->fp = fopen(filename, "wb");
+    if (!w->fp) return 1;
+    memcpy(w->header.magic, ARCHIVE_MAGIC, sizeof(w->header.magic));
+    w->header.version = ARCHIVE_VERSION;
+    w->header.block_primes = ARCHIVE_BLOCK_PRIMES;
+    w->header.data_offset = sizeof(ArchiveHeader);
+    // placeholder, real header is written once the counts are known
+    if (fwrite(&w->header, sizeof(w->header), 1, w->fp) != 1) {
+        fclose(w->fp);
+        return 1;
+    }
+    return 0;
+}
+
+int archive_append(ArchiveWriter* w, uint64_t p) {
+    // primes must come in ascending order
+    if (w->header.count && p <= w->last_prime) return 1;
+
+    if (w->header.count % w->header.block_primes == 0) {
+        // first prime of a block goes in the index, not the data
+        if (w->header.nblocks == w->index_capacity) {
+            size_t capacity = w->index_capacity ? w->index_capacity * 2 : 1024;
+            ArchiveIndexEntry* grown = (ArchiveIndexEntry*)realloc(
+                w->index, capacity * sizeof(*grown));
+            if (!grown) return 1;
+            w->index = grown;
+            w->index_capacity = capacity;
+        }
+        w->index[w->header.nblocks].first_prime = p;
+        w->index[w->header.nblocks].offset = w->data_len;
+        ++w->header.nblocks;
+    } else {
+        uint64_t v = w->last_prime == 2 ? 0 : (p - w->last_prime) / 2;
+        unsigned char buf[10];
+        int len = 0;
+        while (v >= 0x80) {
+            buf[len++] = (unsigned char)(v | 0x80);
+            v >>= 7;
+        }
+        buf[len++] = (unsigned char)v;
+        if (fwrite(buf, 1, len, w->fp) != (size_t)len) return 1;
+        w->data_len += len;
+    }
+    w->last_prime = p;
+    ++w->header.count;
+    return 0;
+}
+
+int archive_append_bits(ArchiveWriter* w, const uint64_t* words,
+                        size_t nwords, long lo) {
+    // append every prime held in a bitset slice (first bit = lo)
+    for (size_t i = 0; i < nwords; ++i) {
+        uint64_t bits = words[i];
+        long base = lo + (long)i * BITSET_WORD_SPAN;
+        while (bits) {
+            if (archive_append(w, (uint64_t)(base + 2 * __builtin_ctzll(bits))))
+                return 1;
+            bits &= bits - 1;
+        }
+    }
+    return 0;
+}
+
+int archive_writer_close(ArchiveWriter* w, uint64_t limit) {
+    int failed = 0;
+    // pad so the index is 8 byte aligned when mapped
+    static const unsigned char zeros[8] = {0};
+    size_t pad = (8 - w->data_len % 8) % 8;
+    failed |= fwrite(zeros, 1, pad, w->fp) != pad;
+
+    w->header.limit = limit;
+    w->header.index_offset = w->header.data_offset + w->data_len + pad;
+    failed |= fwrite(w->index, sizeof(*w->index), w->header.nblocks, w->fp) !=
+              w->header.nblocks;
+    failed |= fseek(w->fp, 0, SEEK_SET) != 0;
+    failed |= fwrite(&w->header, sizeof(w->header), 1, w->fp) != 1;
+    failed |= fclose(w->fp) != 0;
+    free(w->index);
+    w->index = NULL;
+    return failed;
+}
+
+int write_primes_archive(const PrimeBitset* bs, int include_two,
+                         const char* filename) {
+    // whole bitset as an archive of every prime < bs->hi
+    ArchiveWriter w;
+    if (archive_writer_open(&w, filename)) return 1;
+    int failed = include_two && archive_append(&w, 2);
+    failed |= !failed && archive_append_bits(&w, bs->words, bs->nwords, bs->lo);
+    failed |= archive_writer_close(&w, (uint64_t)bs->hi);
+    return failed;
+}
+
+int archive_reader_open(ArchiveReader* r, const char* filename) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return 1;
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(ArchiveHeader)) {
+        close(fd);
+        return 1;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // mapping stays valid after the descriptor is closed
+    close(fd);
+    if (map == MAP_FAILED) return 1;
+    r->map = (const unsigned char*)map;
+    r->map_len = (size_t)st.st_size;
+    r->header = (const ArchiveHeader*)map;
+
+    // make sure the index and data actually fit in the file
+    const ArchiveHeader* h = r->header;
+    if (memcmp(h->magic, ARCHIVE_MAGIC, sizeof(h->magic)) ||
+        h->version != ARCHIVE_VERSION || !h->block_primes ||
+        h->index_offset > r->map_len ||
+        h->nblocks > (r->map_len - h->index_offset) / sizeof(*r->index) ||
+        h->data_offset > h->index_offset ||
+        h->nblocks != (h->count + h->block_primes - 1) / h->block_primes) {
+        archive_reader_close(r);
+        return 1;
+    }
+    r->index = (const ArchiveIndexEntry*)(r->map + h->index_offset);
+    r->data = r->map + h->data_offset;
+    return 0;
+}
+
+void archive_reader_close(ArchiveReader* r) {
+    if (r->map) munmap((void*)r->map, r->map_len);
+    r->map = NULL;
+}
+
+static const unsigned char* archive_seek(const ArchiveReader* r, uint64_t k,
+                                        uint64_t* p) {
+    // k-th prime, plus where the gap to the one after it is stored
+    uint64_t block = k / r->header->block_primes;
+    uint64_t prime = r->index[block].first_prime;
+    const unsigned char* data = r->data + r->index[block].offset;
+    for (uint64_t i = block * r->header->block_primes; i < k; ++i) {
+        uint64_t v;
+        data = read_varint(data, &v);
+        prime = next_prime(prime, v);
+    }
+    *p = prime;
+    return data;
+}
+
+int archive_nth(const ArchiveReader* r, uint64_t k, uint64_t* p) {
+    // k-th prime (from 0) in the archive, jumps straight to its block
+    if (k >= r->header->count) return 1;
+    archive_seek(r, k, p);
+    return 0;
+}
+
+int archive_next_geq(const ArchiveReader* r, uint64_t x, uint64_t* p,
+                     uint64_t* k) {
+    // first prime >= x and its position, 1 if there's none in the archive
+    const ArchiveHeader* h = r->header;
+    if (!h->count) return 1;
+
+    // binary search for the last block starting at or below x
+    uint64_t lo = 0, hi = h->nblocks;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (r->index[mid].first_prime <= x)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    uint64_t i = lo * h->block_primes;
+    uint64_t end = i + h->block_primes < h->count ? i + h->block_primes
+                                                   : h->count;
+    uint64_t prime = r->index[lo].first_prime;
+    const unsigned char* data = r->data + r->index[lo].offset;
+    while (prime < x && i + 1 < end) {
+        uint64_t v;
+        data = read_varint(data, &v);
+        prime = next_prime(prime, v);
+        ++i;
+    }
+    if (prime < x) {
+        // rest of this block is below x, answer is the next block's first
+        if (lo + 1 >= h->nblocks) return 1;
+        prime = r->index[lo + 1].first_prime;
+        ++i;
+    }
+    *p = prime;
+    if (k) *k = i;
+    return 0;
+}
+
+size_t archive_decode(const ArchiveReader* r, uint64_t k, uint64_t* out,
+                      size_t max) {
+    // up to max consecutive primes starting from the k-th
+    size_t n = 0;
+    uint64_t bp = r->header->block_primes;
+    uint64_t prime;
+    if (k >= r->header->count || !max) return 0;
+    const unsigned char* data = archive_seek(r, k, &prime);
+    out[n++] = prime;
+    for (uint64_t i = k + 1; n < max && i < r->header->count; ++i) {
+        if (i % bp == 0) {
+            // new block, restart from the index
+            prime = r->index[i / bp].first_prime;
+            data = r->data + r->index[i / bp].offset;
+        } else {
+            uint64_t v;
+            data = read_varint(data, &v);
+            prime = next_prime(prime, v);
+        }
+        out[n++] = prime;
+    }
+    return n;
+}
@@ -0,0 +1,64 @@
+#ifndef ARCHIVE_H_INCLUDED
+#define ARCHIVE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bitset.h"
+
+// binary prime archive:
+//   header, then blocks of ARCHIVE_BLOCK_PRIMES primes, then the block index
+// a block stores its first prime in the index and every following prime as
+// a varint of half the gap to the one before (gap from 2 to 3 is stored
+// as 0), so nearly every prime costs one byte
+#define ARCHIVE_MAGIC "PRIMEGAP"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_PRIMES 4096
+
+typedef struct {
+    char magic[8];
+    uint64_t version;
+    uint64_t count;         // primes in the archive
+    uint64_t limit;         // archive holds every prime < limit
+    uint64_t block_primes;  // primes per block, last block may be short
+    uint64_t nblocks;
+    uint64_t index_offset;  // byte offset of the ArchiveIndexEntry array
+    uint64_t data_offset;   // byte offset of block 0
+} ArchiveHeader;
+
+typedef struct {
+    uint64_t first_prime;
+    uint64_t offset;  // of the block's gaps, relative to data_offset
+} ArchiveIndexEntry;
+
+typedef struct {
+    FILE* fp;
+    ArchiveHeader header;
+    ArchiveIndexEntry* index;
+    size_t index_capacity;
+    uint64_t last_prime;
+    uint64_t data_len;
+} ArchiveWriter;
+
+typedef struct {
+    const unsigned char* map;
+    size_t map_len;
+    const ArchiveHeader* header;
+    const ArchiveIndexEntry* index;
+    const unsigned char* data;
+} ArchiveReader;
+
+int archive_writer_open(ArchiveWriter*, const char*);
+int archive_append(ArchiveWriter*, uint64_t);
+int archive_append_bits(ArchiveWriter*, const uint64_t*, size_t, long);
+int archive_writer_close(ArchiveWriter*, uint64_t);
+int write_primes_archive(const PrimeBitset*, int, const char*);
+
+int archive_reader_open(ArchiveReader*, const char*);
+void archive_reader_close(ArchiveReader*);
+int archive_nth(const ArchiveReader*, uint64_t, uint64_t*);
+int archive_next_geq(const ArchiveReader*, uint64_t, uint64_t*, uint64_t*);
+size_t archive_decode(const ArchiveReader*, uint64_t, uint64_t*, size_t);
+
+#endif
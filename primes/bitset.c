@@ -0,0 +1,69 @@
+#include "bitset.h"
+
+#include <stdlib.h>
+
+size_t bitset_words_for(long lo, long hi) {
+    // odd numbers in [lo, hi) rounded up to whole words
+    if (hi <= lo) return 0;
+    size_t nbits = (size_t)(hi - lo + 1) / 2;
+    return (nbits + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+}
+
+int bitset_init(PrimeBitset* bs, long lo, long hi) {
+    bs->lo = lo;
+    bs->hi = hi > lo ? hi : lo;
+    bs->nbits = (size_t)(bs->hi - lo + 1) / 2;
+    bs->nwords = bitset_words_for(lo, bs->hi);
+    // zeroed so padding bits past hi never read as prime
+    bs->words = (uint64_t*)calloc(bs->nwords ? bs->nwords : 1,
+                                  sizeof(uint64_t));
+    return bs->words == NULL;
+}
+
+void bitset_free(PrimeBitset* bs) {
+    free(bs->words);
+    bs->words = NULL;
+    bs->nbits = bs->nwords = 0;
+}
+
+size_t bitset_popcount(const uint64_t* words, size_t nwords) {
+    size_t count = 0;
+    for (size_t i = 0; i < nwords; ++i)
+        count += (size_t)__builtin_popcountll(words[i]);
+    return count;
+}
+
+size_t bitset_count(const PrimeBitset* bs) {
+    return bitset_popcount(bs->words, bs->nwords);
+}
+
+long bitset_next(const PrimeBitset* bs, long x) {
+    // smallest prime >= x held in the bitset, -1 if none
+    if (x < bs->lo) x = bs->lo;
+    if (x >= bs->hi) return -1;
+    size_t k = (size_t)(x - bs->lo + 1) / 2;
+    size_t w = k / BITSET_WORD_BITS;
+    // ignore bits below k in the first word
+    uint64_t bits = bs->words[w] & (~0ULL << (k % BITSET_WORD_BITS));
+    while (!bits) {
+        if (++w >= bs->nwords) return -1;
+        bits = bs->words[w];
+    }
+    long p = bs->lo + 2 * (long)(w * BITSET_WORD_BITS + __builtin_ctzll(bits));
+    return p < bs->hi ? p : -1;
+}
+
+size_t bitset_collect(const uint64_t* words, size_t nwords, long lo,
+                      long* out) {
+    // materialise the primes held in words (first bit = lo) into out
+    size_t count = 0;
+    for (size_t w = 0; w < nwords; ++w) {
+        uint64_t bits = words[w];
+        long base = lo + (long)w * BITSET_WORD_SPAN;
+        while (bits) {
+            out[count++] = base + 2 * __builtin_ctzll(bits);
+            bits &= bits - 1;  // clear lowest set bit
+        }
+    }
+    return count;
+}
@@ -0,0 +1,29 @@
+#ifndef BITSET_H_INCLUDED
+#define BITSET_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// odd numbers covered by one 64 bit word
+#define BITSET_WORD_BITS 64
+#define BITSET_WORD_SPAN (2L * BITSET_WORD_BITS)
+
+// primality of the odd numbers in [lo, hi), bit k of the array is lo + 2k
+// 16 numbers per byte, so primes < 10^10 fit in ~625MB
+typedef struct {
+    long lo;  // odd
+    long hi;
+    size_t nbits;
+    size_t nwords;
+    uint64_t* words;
+} PrimeBitset;
+
+int bitset_init(PrimeBitset*, long, long);
+void bitset_free(PrimeBitset*);
+size_t bitset_words_for(long, long);
+size_t bitset_popcount(const uint64_t*, size_t);
+size_t bitset_count(const PrimeBitset*);
+long bitset_next(const PrimeBitset*, long);
+size_t bitset_collect(const uint64_t*, size_t, long, long*);
+
+#endif
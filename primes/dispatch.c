@@ -0,0 +1,107 @@
+#include "dispatch.h"
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void dispatch_request(ChunkDispatcher* d) {
+    // ask root for another chunk, reply picked up in dispatch_next
+    char buf = '\0';
+    MPI_Irecv(&d->incoming, 1, MPI_LONG, d->root, DISPATCH_CHUNK_TAG, d->comm,
+              &d->reply_req);
+    MPI_Send(&buf, 1, MPI_CHAR, d->root, DISPATCH_REQUEST_TAG, d->comm);
+    d->in_flight = 1;
+}
+
+static void dispatch_serve(ChunkDispatcher* d, int blocking) {
+    // answer requests from other ranks, -1 means no chunks left
+    int available = blocking;
+    MPI_Status status;
+    char buf;
+    if (!blocking)
+        MPI_Iprobe(MPI_ANY_SOURCE, DISPATCH_REQUEST_TAG, d->comm, &available,
+                   &status);
+    while (available) {
+        MPI_Recv(&buf, 1, MPI_CHAR, MPI_ANY_SOURCE, DISPATCH_REQUEST_TAG,
+                 d->comm, &status);
+        long chunk = d->next_chunk < d->chunks ? d->next_chunk++ : -1;
+        if (chunk == -1) ++d->finished_ranks;
+        MPI_Send(&chunk, 1, MPI_LONG, status.MPI_SOURCE, DISPATCH_CHUNK_TAG,
+                 d->comm);
+        if (blocking) return;
+        MPI_Iprobe(MPI_ANY_SOURCE, DISPATCH_REQUEST_TAG, d->comm, &available,
+                   &status);
+    }
+}
+
+void dispatch_init(ChunkDispatcher* d, MPI_Comm comm, int root, long chunks) {
+    d->comm = comm;
+    d->root = root;
+    d->chunks = chunks;
+    d->next_chunk = 0;
+    d->finished_ranks = 0;
+    d->in_flight = 0;
+    MPI_Comm_rank(comm, &d->rank);
+    MPI_Comm_size(comm, &d->size);
+    if (d->rank != root) dispatch_request(d);
+}
+
+int dispatch_next(ChunkDispatcher* d, long* chunk) {
+    // next chunk for this rank, 0 once there are none left
+    if (d->rank == d->root) {
+        dispatch_serve(d, 0);
+        if (d->next_chunk >= d->chunks) return 0;
+        *chunk = d->next_chunk++;
+        return 1;
+    }
+
+    if (!d->in_flight) return 0;
+    MPI_Wait(&d->reply_req, MPI_STATUS_IGNORE);
+    d->in_flight = 0;
+    if (d->incoming < 0) return 0;
+    *chunk = d->incoming;
+    // prefetch the one after, overlapping the round trip with this chunk
+    dispatch_request(d);
+    return 1;
+}
+
+void dispatch_finish(ChunkDispatcher* d) {
+    // root keeps answering until every other rank has been told to stop
+    if (d->rank != d->root) return;
+    while (d->finished_ranks < d->size - 1) dispatch_serve(d, 1);
+}
+
+void dispatch_report(MPI_Comm comm, int root, double busy_time, long chunks) {
+    // print how busy each rank was so any imbalance is visible
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    double* all_busy = NULL;
+    long* all_chunks = NULL;
+    if (rank == root) {
+        all_busy = (double*)malloc(size * sizeof(*all_busy));
+        all_chunks = (long*)malloc(size * sizeof(*all_chunks));
+        if (!all_busy || !all_chunks) {
+            printf("Could not malloc\n");
+            MPI_Abort(comm, 1);
+        }
+    }
+    MPI_Gather(&busy_time, 1, MPI_DOUBLE, all_busy, 1, MPI_DOUBLE, root, comm);
+    MPI_Gather(&chunks, 1, MPI_LONG, all_chunks, 1, MPI_LONG, root, comm);
+
+    if (rank == root) {
+        double max_busy = 0, total_busy = 0;
+        for (int i = 0; i < size; ++i) {
+            printf("Rank %d: busy %.3f s, %ld chunks\n", i, all_busy[i],
+                   all_chunks[i]);
+            total_busy += all_busy[i];
+            if (all_busy[i] > max_busy) max_busy = all_busy[i];
+        }
+        if (total_busy > 0)
+            printf("Imbalance (max / mean busy): %.3f\n",
+                   max_busy * size / total_busy);
+        fflush(stdout);
+        free(all_busy);
+        free(all_chunks);
+    }
+}
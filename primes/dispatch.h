@@ -0,0 +1,33 @@
+#ifndef DISPATCH_H_INCLUDED
+#define DISPATCH_H_INCLUDED
+
+#include <mpi.h>
+
+#define DISPATCH_REQUEST_TAG 100
+#define DISPATCH_CHUNK_TAG 101
+
+// hands out chunk ids 0..chunks-1 to ranks as they ask for them
+// root works through chunks too and answers requests in between its own
+// chunks, other ranks always keep one request in flight so that answer
+// is normally already there by the time they finish a chunk
+typedef struct {
+    MPI_Comm comm;
+    int rank;
+    int size;
+    int root;
+    long chunks;
+    // root only
+    long next_chunk;
+    int finished_ranks;  // ranks that have been told there's nothing left
+    // other ranks only
+    long incoming;  // reply buffer for the request in flight
+    MPI_Request reply_req;
+    int in_flight;
+} ChunkDispatcher;
+
+void dispatch_init(ChunkDispatcher*, MPI_Comm, int, long);
+int dispatch_next(ChunkDispatcher*, long*);
+void dispatch_finish(ChunkDispatcher*);
+void dispatch_report(MPI_Comm, int, double, long);
+
+#endif
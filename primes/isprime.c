@@ -0,0 +1,32 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "primality.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: %s n [n ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        char* ptr;
+        uint64_t n = strtoull(argv[i], &ptr, 10);
+        if (ptr == argv[i]) {
+            printf("Couldn't convert n: %s\n", argv[i]);
+            return 1;
+        }
+
+        struct timespec start, finish;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int prime = is_prime(n);
+        clock_gettime(CLOCK_MONOTONIC, &finish);
+        double elapsed_us = (finish.tv_sec - start.tv_sec) * 1e6 +
+                            (finish.tv_nsec - start.tv_nsec) / 1e3;
+        printf("%" PRIu64 " is %s (%.3f us)\n", n,
+               prime ? "prime" : "not prime", elapsed_us);
+    }
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "presieve.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PRESIEVE_X86 1
+#endif
+
+// bit k of word j is set iff global odd number 2(64j + k) + 1 has no
+// factor in the tile primes, the extra word repeats word 0 so shifted
+// copies can always read one word ahead
+static uint64_t tile[PRESIEVE_TILE_WORDS + 1];
+
+static const long pattern_primes[] = {17, 19, 23, 29, 31, 37,
+                                      41, 43, 47, 53, 59, 61};
+#define PATTERN_COUNT (sizeof(pattern_primes) / sizeof(*pattern_primes))
+// each prime's p word pattern stored twice, so a vector load starting at
+// any index < p stays in bounds
+static uint64_t pattern_words[2 * (17 + 19 + 23 + 29 + 31 + 37 + 41 + 43 +
+                                   47 + 53 + 59 + 61)];
+static const uint64_t* patterns[PATTERN_COUNT];
+
+typedef void (*PatternKernel)(uint64_t*, size_t, size_t*);
+static PatternKernel pattern_kernel;
+static const char* pattern_kernel_name;
+static pthread_once_t presieve_once = PTHREAD_ONCE_INIT;
+
+static void clear_multiples(uint64_t* words, size_t nwords, long p) {
+    // global bit g is 2g + 1, so p's odd multiples are g = (p - 1) / 2 + ip
+    for (size_t g = (size_t)(p - 1) / 2; g < nwords * 64; g += (size_t)p)
+        words[g / 64] &= ~(1ULL << (g % 64));
+}
+
+static void apply_patterns_scalar(uint64_t* words, size_t nwords,
+                                  size_t* idx) {
+    for (size_t w = 0; w < nwords; ++w) {
+        uint64_t v = words[w];
+        for (size_t j = 0; j < PATTERN_COUNT; ++j) {
+            v &= patterns[j][idx[j]];
+            if (++idx[j] == (size_t)pattern_primes[j]) idx[j] = 0;
+        }
+        words[w] = v;
+    }
+}
+
+#ifdef PRESIEVE_X86
+// every pattern is ANDed into a vector of words before it's stored back,
+// one load and store per vector instead of one per pattern
+__attribute__((target("sse2"))) static void apply_patterns_sse2(
+    uint64_t* words, size_t nwords, size_t* idx) {
+    size_t w = 0;
+    for (; w + 2 <= nwords; w += 2) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(words + w));
+        for (size_t j = 0; j < PATTERN_COUNT; ++j) {
+            v = _mm_and_si128(
+                v, _mm_loadu_si128((const __m128i*)(patterns[j] + idx[j])));
+            idx[j] += 2;
+            if (idx[j] >= (size_t)pattern_primes[j])
+                idx[j] -= (size_t)pattern_primes[j];
+        }
+        _mm_storeu_si128((__m128i*)(words + w), v);
+    }
+    apply_patterns_scalar(words + w, nwords - w, idx);
+}
+
+__attribute__((target("avx2"))) static void apply_patterns_avx2(
+    uint64_t* words, size_t nwords, size_t* idx) {
+    size_t w = 0;
+    for (; w + 4 <= nwords; w += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(words + w));
+        for (size_t j = 0; j < PATTERN_COUNT; ++j) {
+            v = _mm256_and_si256(
+                v,
+                _mm256_loadu_si256((const __m256i*)(patterns[j] + idx[j])));
+            idx[j] += 4;
+            if (idx[j] >= (size_t)pattern_primes[j])
+                idx[j] -= (size_t)pattern_primes[j];
+        }
+        _mm256_storeu_si256((__m256i*)(words + w), v);
+    }
+    apply_patterns_scalar(words + w, nwords - w, idx);
+}
+#endif
+
+static void build_presieve(void) {
+    memset(tile, 0xff, sizeof(tile));
+    for (long p = 3; p < PRESIEVE_TILE_LIMIT; p += 2)
+        if (p != 9 && p != 15) clear_multiples(tile, PRESIEVE_TILE_WORDS, p);
+    tile[PRESIEVE_TILE_WORDS] = tile[0];
+
+    uint64_t* at = pattern_words;
+    for (size_t j = 0; j < PATTERN_COUNT; ++j) {
+        size_t p = (size_t)pattern_primes[j];
+        memset(at, 0xff, p * sizeof(uint64_t));
+        clear_multiples(at, p, (long)p);
+        memcpy(at + p, at, p * sizeof(uint64_t));
+        patterns[j] = at;
+        at += 2 * p;
+    }
+
+    // PRIMES_SIMD=scalar|sse2|avx2 forces a kernel, for testing/benchmarks
+    const char* force = getenv("PRIMES_SIMD");
+    pattern_kernel = apply_patterns_scalar;
+    pattern_kernel_name = "scalar";
+    if (force && !strcmp(force, "scalar")) return;
+#ifdef PRESIEVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && !(force && !strcmp(force, "sse2"))) {
+        pattern_kernel = apply_patterns_avx2;
+        pattern_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        pattern_kernel = apply_patterns_sse2;
+        pattern_kernel_name = "sse2";
+    }
+#endif
+}
+
+const char* presieve_kernel(void) {
+    pthread_once(&presieve_once, build_presieve);
+    return pattern_kernel_name;
+}
+
+long presieve_fill(uint64_t* words, long lo, long hi, size_t nwords) {
+    // start words for [lo, hi), lo odd, with every multiple of the smallest
+    // primes cleared, returns the first prime the caller still has to do
+    pthread_once(&presieve_once, build_presieve);
+    size_t g0 = (size_t)(lo - 1) / 2;
+    size_t j = g0 / 64 % PRESIEVE_TILE_WORDS;
+    unsigned shift = (unsigned)(g0 % 64);
+    long done_below = PRESIEVE_TILE_LIMIT;
+
+    if (shift == 0) {
+        // tile wraps at most a few times per segment, copy whole runs
+        for (size_t w = 0; w < nwords;) {
+            size_t run = PRESIEVE_TILE_WORDS - j;
+            if (run > nwords - w) run = nwords - w;
+            memcpy(words + w, tile + j, run * sizeof(uint64_t));
+            w += run;
+            j = 0;
+        }
+        // patterns line up with words only when lo does
+        size_t idx[PATTERN_COUNT];
+        for (size_t k = 0; k < PATTERN_COUNT; ++k)
+            idx[k] = g0 / 64 % (size_t)pattern_primes[k];
+        pattern_kernel(words, nwords, idx);
+        done_below = PRESIEVE_PATTERN_LIMIT;
+    } else {
+        for (size_t w = 0; w < nwords; ++w) {
+            words[w] = tile[j] >> shift | tile[j + 1] << (64 - shift);
+            if (++j == PRESIEVE_TILE_WORDS) j = 0;
+        }
+    }
+
+    // the patterns cleared the small primes themselves too, put them back
+    for (long p = 3; p < done_below && p < hi; p += 2) {
+        if (p < lo) continue;
+        int prime = 1;
+        for (long d = 3; d * d <= p; d += 2) prime &= p % d != 0;
+        if (prime) words[(p - lo) / 2 / 64] |= 1ULL << ((p - lo) / 2 % 64);
+    }
+    return done_below;
+}
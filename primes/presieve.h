@@ -0,0 +1,19 @@
+#ifndef PRESIEVE_H_INCLUDED
+#define PRESIEVE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// multiples of 3, 5, 7, 11 and 13 repeat every 3*5*7*11*13 odd numbers,
+// so every 15015 words, one tile of that is copied into each segment
+#define PRESIEVE_TILE_WORDS 15015
+#define PRESIEVE_TILE_LIMIT 17
+// primes from there up to this one clear at least one bit in most words,
+// each has a p word pattern ANDed in, vectorised where the CPU allows
+#define PRESIEVE_PATTERN_LIMIT 64
+
+// first prime the segment sieve still has to cross off itself
+long presieve_fill(uint64_t*, long, long, size_t);
+const char* presieve_kernel(void);
+
+#endif
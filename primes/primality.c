@@ -0,0 +1,127 @@
+#include "primality.h"
+
+#include <pthread.h>
+
+// bit k set iff 2k + 1 is prime, for every odd number below the limit
+static uint64_t small_primes[PRIMALITY_TABLE_LIMIT / 128];
+static pthread_once_t small_primes_once = PTHREAD_ONCE_INIT;
+
+// odd primes to trial divide by before falling back to Miller-Rabin,
+// cheaply rejects most composites
+static const uint32_t trial_primes[] = {3,  5,  7,  11, 13, 17, 19, 23,
+                                        29, 31, 37, 41, 43, 47, 53};
+
+// with these bases Miller-Rabin is exact for every n < 2^64
+static const uint64_t mr_bases[] = {2,      325,     9375,      28178,
+                                    450775, 9780504, 1795265022};
+
+typedef struct {
+    uint64_t n;
+    uint64_t n_inv;  // n^-1 mod 2^64
+    uint64_t one;    // 1 in montgomery form, 2^64 mod n
+    uint64_t r2;     // 2^128 mod n, converts into montgomery form
+} Montgomery;
+
+static void build_small_primes(void) {
+    // plain sieve over the odd numbers below the limit
+    for (size_t i = 0; i < sizeof(small_primes) / sizeof(*small_primes); ++i)
+        small_primes[i] = ~0ULL;
+    small_primes[0] &= ~1ULL;  // 1 isn't prime
+    for (uint64_t p = 3; p * p < PRIMALITY_TABLE_LIMIT; p += 2) {
+        if (!(small_primes[p / 128] >> (p / 2 % 64) & 1)) continue;
+        for (uint64_t m = p * p; m < PRIMALITY_TABLE_LIMIT; m += 2 * p)
+            small_primes[m / 128] &= ~(1ULL << (m / 2 % 64));
+    }
+}
+
+static void mont_init(Montgomery* m, uint64_t n) {
+    // n odd, newton iteration doubles the correct low bits each step
+    uint64_t inv = n;  // correct to 3 bits since n * n = 1 mod 8
+    for (int i = 0; i < 5; ++i) inv *= 2 - n * inv;
+    m->n = n;
+    m->n_inv = inv;
+    m->one = (0 - n) % n;
+    m->r2 = (uint64_t)((unsigned __int128)m->one * m->one % n);
+}
+
+static uint64_t mont_reduce(const Montgomery* m, unsigned __int128 t) {
+    // t * 2^-64 mod n, for t < n * 2^64
+    uint64_t q = (uint64_t)t * m->n_inv;
+    uint64_t qn_hi = (uint64_t)(((unsigned __int128)q * m->n) >> 64);
+    uint64_t t_hi = (uint64_t)(t >> 64);
+    // low halves of t and q * n are equal, so they cancel exactly
+    return t_hi >= qn_hi ? t_hi - qn_hi : t_hi - qn_hi + m->n;
+}
+
+static uint64_t mont_mul(const Montgomery* m, uint64_t a, uint64_t b) {
+    return mont_reduce(m, (unsigned __int128)a * b);
+}
+
+static int mr_witness(const Montgomery* m, uint64_t a, uint64_t d, int s) {
+    // 1 if base a proves n composite
+    uint64_t neg_one = m->n - m->one;
+    uint64_t base = mont_mul(m, a % m->n, m->r2);
+    if (!base) return 0;  // a multiple of n, says nothing
+
+    // x = a^d by square and multiply, all in montgomery form
+    uint64_t x = m->one;
+    for (; d; d >>= 1) {
+        if (d & 1) x = mont_mul(m, x, base);
+        base = mont_mul(m, base, base);
+    }
+    if (x == m->one || x == neg_one) return 0;
+    for (int i = 1; i < s; ++i) {
+        x = mont_mul(m, x, x);
+        if (x == neg_one) return 0;
+    }
+    return 1;
+}
+
+static int is_prime_large(uint64_t n) {
+    // n odd, >= the table limit and not divisible by any trial prime
+    Montgomery m;
+    mont_init(&m, n);
+    uint64_t d = n - 1;
+    int s = __builtin_ctzll(d);
+    d >>= s;
+    for (size_t i = 0; i < sizeof(mr_bases) / sizeof(*mr_bases); ++i)
+        if (mr_witness(&m, mr_bases[i], d, s)) return 0;
+    return 1;
+}
+
+static int is_prime_small(uint64_t n) {
+    // n < PRIMALITY_TABLE_LIMIT
+    if (n < 3) return n == 2;
+    if (!(n & 1)) return 0;
+    return small_primes[n / 128] >> (n / 2 % 64) & 1;
+}
+
+static int has_trial_factor(uint64_t n) {
+    for (size_t i = 0; i < sizeof(trial_primes) / sizeof(*trial_primes); ++i)
+        if (n % trial_primes[i] == 0) return 1;
+    return 0;
+}
+
+int is_prime(uint64_t n) {
+    pthread_once(&small_primes_once, build_small_primes);
+    if (n < PRIMALITY_TABLE_LIMIT) return is_prime_small(n);
+    if (!(n & 1) || has_trial_factor(n)) return 0;
+    return is_prime_large(n);
+}
+
+void is_prime_batch(const uint64_t* candidates, size_t count,
+                    unsigned char* out) {
+    // cheap filters over the whole batch first, then Miller-Rabin only on
+    // what survives
+    pthread_once(&small_primes_once, build_small_primes);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t n = candidates[i];
+        if (n < PRIMALITY_TABLE_LIMIT)
+            out[i] = (unsigned char)is_prime_small(n);
+        else
+            out[i] = (n & 1) && !has_trial_factor(n);
+    }
+    for (size_t i = 0; i < count; ++i)
+        if (out[i] && candidates[i] >= PRIMALITY_TABLE_LIMIT)
+            out[i] = (unsigned char)is_prime_large(candidates[i]);
+}
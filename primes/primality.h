@@ -0,0 +1,13 @@
+#ifndef PRIMALITY_H_INCLUDED
+#define PRIMALITY_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// numbers below this are answered straight from a bitmap
+#define PRIMALITY_TABLE_LIMIT 65536
+
+int is_prime(uint64_t);
+void is_prime_batch(const uint64_t*, size_t, unsigned char*);
+
+#endif
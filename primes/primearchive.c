@@ -0,0 +1,86 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+
+// primes decoded per batch when dumping
+#define DUMP_BATCH 4096
+
+int parse_u64(const char* str, uint64_t* out);
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf(
+            "Usage: %s file info\n"
+            "       %s file nth k        (k-th prime, counting from 0)\n"
+            "       %s file geq x        (first prime >= x)\n"
+            "       %s file dump [k] [count]\n",
+            argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+
+    ArchiveReader r;
+    if (archive_reader_open(&r, argv[1])) {
+        printf("Couldn't open archive: %s\n", argv[1]);
+        return 1;
+    }
+    const ArchiveHeader* h = r.header;
+    int status = 0;
+    uint64_t k, x, p;
+
+    if (!strcmp(argv[2], "info")) {
+        printf("Primes: %" PRIu64 "\n", h->count);
+        printf("Limit: %" PRIu64 "\n", h->limit);
+        printf("Blocks: %" PRIu64 " of %" PRIu64 " primes\n", h->nblocks,
+               h->block_primes);
+        printf("Bytes per prime: %.3f\n",
+               h->count ? (double)r.map_len / h->count : 0.0);
+    } else if (!strcmp(argv[2], "nth") && argc == 4 && !parse_u64(argv[3], &k)) {
+        if (archive_nth(&r, k, &p)) {
+            printf("Archive only holds %" PRIu64 " primes\n", h->count);
+            status = 1;
+        } else {
+            printf("%" PRIu64 "\n", p);
+        }
+    } else if (!strcmp(argv[2], "geq") && argc == 4 && !parse_u64(argv[3], &x)) {
+        if (archive_next_geq(&r, x, &p, &k)) {
+            printf("No prime >= %" PRIu64 " below %" PRIu64 "\n", x, h->limit);
+            status = 1;
+        } else {
+            printf("%" PRIu64 " (prime #%" PRIu64 ")\n", p, k);
+        }
+    } else if (!strcmp(argv[2], "dump") && argc <= 5) {
+        uint64_t count = h->count;
+        k = 0;
+        if ((argc >= 4 && parse_u64(argv[3], &k)) ||
+            (argc == 5 && parse_u64(argv[4], &count))) {
+            printf("Couldn't parse to a number\n");
+            status = 1;
+        } else {
+            uint64_t batch[DUMP_BATCH];
+            while (count) {
+                size_t want = count < DUMP_BATCH ? (size_t)count : DUMP_BATCH;
+                size_t got = archive_decode(&r, k, batch, want);
+                if (!got) break;
+                for (size_t i = 0; i < got; ++i)
+                    printf("%" PRIu64 "\n", batch[i]);
+                k += got;
+                count -= got;
+            }
+        }
+    } else {
+        printf("Unknown command: %s\n", argv[2]);
+        status = 1;
+    }
+
+    archive_reader_close(&r);
+    return status;
+}
+
+int parse_u64(const char* str, uint64_t* out) {
+    char* ptr;
+    *out = strtoull(str, &ptr, 10);
+    return ptr == str;
+}
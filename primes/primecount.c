@@ -0,0 +1,337 @@
+#include "primecount.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sieve.h"
+
+// pi(x) without listing primes, Legendre style dynamic programming over the
+// O(sqrt x) distinct values of x / i (Lucy's algorithm):
+//   S(v) = count of 2..v left after crossing off multiples of primes < p
+//   crossing off p: S(v) -= S(v / p) - S(p - 1) for every v >= p^2
+// once every prime <= sqrt(x) is done S(v) = pi(v), O(x^(3/4)) time
+// hi[i] = S(x / i) for i <= r, lo[v] = S(v) for v <= r, r = sqrt(x)
+
+typedef struct {
+    long x;
+    long r;
+    long* hi;
+    long* lo;
+    long* delta;  // scratch for the parallel hi update
+    const SieveBase* base;
+    int threads;
+    pthread_barrier_t* barrier;
+} PiShared;
+
+typedef struct {
+    int id;
+    PiShared* shared;
+} PiWorker;
+
+// x / d in double is exact for x < 2^53: x / d is either an integer or at
+// least 1 / d away from one, more than the x * 2^-53 / d rounding error
+// and a double divide is several times faster than a 64 bit integer one
+static long quotient(const PiShared* s, long d) {
+    if (s->x < PRIMECOUNT_DOUBLE_LIMIT) return (long)((double)s->x / (double)d);
+    return s->x / d;
+}
+
+static void cross_off_serial(PiShared* s, long p) {
+    long sp = s->lo[p - 1];
+    long m = s->x / (p * p) < s->r ? s->x / (p * p) : s->r;
+    // ascending i reads hi[i * p] before it gets updated
+    for (long i = 1; i <= m; ++i) {
+        long d = i * p;
+        s->hi[i] -= (d <= s->r ? s->hi[d] : s->lo[quotient(s, d)]) - sp;
+    }
+    // descending v reads lo[v / p] before it gets updated
+    for (long v = s->r; v >= p * p; --v) s->lo[v] -= s->lo[v / p] - sp;
+}
+
+static void cross_off_parallel(PiShared* s, int id, long p) {
+    long sp = s->lo[p - 1];
+    long m = s->x / (p * p) < s->r ? s->x / (p * p) : s->r;
+    long i_lo = 1 + m * id / s->threads;
+    long i_hi = 1 + m * (id + 1) / s->threads;
+
+    // every thread reads old values first, then every thread writes
+    for (long i = i_lo; i < i_hi; ++i) {
+        long d = i * p;
+        s->delta[i] = (d <= s->r ? s->hi[d] : s->lo[quotient(s, d)]) - sp;
+    }
+    pthread_barrier_wait(s->barrier);
+    for (long i = i_lo; i < i_hi; ++i) s->hi[i] -= s->delta[i];
+
+    long p2 = p * p;
+    if (p2 > s->r) return;
+    if (p * p2 > s->r) {
+        // lo[v / p] <= r / p < p^2, never written this stage, so any order
+        long span = s->r - p2 + 1;
+        long v_lo = p2 + span * id / s->threads;
+        long v_hi = p2 + span * (id + 1) / s->threads;
+        for (long v = v_lo; v < v_hi; ++v) s->lo[v] -= s->lo[v / p] - sp;
+    } else if (id == 0) {
+        // reads overlap writes, only a handful of tiny primes get here
+        for (long v = s->r; v >= p2; --v) s->lo[v] -= s->lo[v / p] - sp;
+    }
+}
+
+static void* pi_thread(void* arg) {
+    PiWorker* w = (PiWorker*)arg;
+    PiShared* s = w->shared;
+
+    // 2 then the odd base primes, every thread walks the same list so they
+    // all agree on which stages are split and meet at the same barriers
+    for (size_t k = 0; k <= s->base->count; ++k) {
+        long p = k == 0 ? 2 : s->base->primes[k - 1];
+        if (p * p > s->x) break;
+        long m = s->x / (p * p) < s->r ? s->x / (p * p) : s->r;
+        if (m < PRIMECOUNT_PARALLEL_MIN || s->threads == 1) {
+            if (w->id == 0) cross_off_serial(s, p);
+            continue;
+        }
+        // wait for any serial stages, and the last stage, to finish
+        pthread_barrier_wait(s->barrier);
+        cross_off_parallel(s, w->id, p);
+        pthread_barrier_wait(s->barrier);
+    }
+    return NULL;
+}
+
+long prime_pi(long x, int threads) {
+    // number of primes <= x, -1 if out of memory
+    if (x < 2) return 0;
+    if (threads < 1) threads = 1;
+    PiShared s;
+    SieveBase base;
+    s.x = x;
+    s.r = isqrt(x);
+    s.threads = threads;
+    s.base = &base;
+    s.hi = (long*)malloc((size_t)(s.r + 1) * sizeof(long));
+    s.lo = (long*)malloc((size_t)(s.r + 1) * sizeof(long));
+    s.delta = (long*)malloc((size_t)(s.r + 1) * sizeof(long));
+    if (!s.hi || !s.lo || !s.delta || sieve_base_init(&base, x)) {
+        free(s.hi);
+        free(s.lo);
+        free(s.delta);
+        return -1;
+    }
+    // before crossing anything off, S(v) counts 2..v
+    for (long v = 0; v <= s.r; ++v) s.lo[v] = v - 1;
+    s.lo[0] = 0;
+    for (long i = 1; i <= s.r; ++i) s.hi[i] = x / i - 1;
+
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, (unsigned)threads);
+    s.barrier = &barrier;
+    pthread_t* tid = (pthread_t*)malloc(threads * sizeof(*tid));
+    PiWorker* workers = (PiWorker*)malloc(threads * sizeof(*workers));
+    long result = -1;
+    if (tid && workers) {
+        for (int i = 0; i < threads; ++i) {
+            workers[i].id = i;
+            workers[i].shared = &s;
+            pthread_create(&tid[i], NULL, pi_thread, &workers[i]);
+        }
+        for (int i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+        result = s.hi[1];
+    }
+
+    pthread_barrier_destroy(&barrier);
+    free(tid);
+    free(workers);
+    sieve_base_free(&base);
+    free(s.hi);
+    free(s.lo);
+    free(s.delta);
+    return result;
+}
+
+// the split count, see primecount.h
+// special leaves are -mu(m) phi(x / (m p_(b+1)), b) for squarefree m <= y
+// with m p_(b+1) > y and every prime factor of m above p_(b+1), where
+// phi(z, b) counts 1..z with no factor among the first b primes
+// P2 is the sum over y < p <= sqrt x of pi(x / p) - pi(p) + 1, and once the
+// a primes <= y are crossed off, 1..z left is 1 and the primes in (y, z]
+
+static long icbrt(long n) {
+    // largest r with r^3 <= n
+    long lo = 0, hi = 2097152;
+    while (lo < hi) {
+        long mid = (lo + hi + 1) / 2;
+        if (mid * mid * mid <= n)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static long primes_upto(const PiSplit* s, long v) {
+    // number of primes <= v, counting only those up to sqrt x
+    long lo = 0, hi = s->nprimes;
+    while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (s->primes[mid] <= v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int pi_split_init(PiSplit* s, long x) {
+    // x >= 2, 1 if out of memory
+    long r = isqrt(x);
+    s->x = x;
+    s->y = PRIMECOUNT_ALPHA * icbrt(x);
+    if (s->y > r) s->y = r;
+    s->limit = x / s->y;
+    s->mu = (signed char*)malloc((size_t)s->y + 1);
+    s->lpf = (int*)calloc((size_t)s->y + 1, sizeof(int));
+    SieveBase base;
+    if (!s->mu || !s->lpf || sieve_base_init(&base, x)) {
+        free(s->mu);
+        free(s->lpf);
+        return 1;
+    }
+    s->primes = (long*)malloc((base.count + 1) * sizeof(long));
+    if (!s->primes) {
+        sieve_base_free(&base);
+        free(s->mu);
+        free(s->lpf);
+        return 1;
+    }
+    // the base can run one past sqrt x
+    s->primes[0] = 2;
+    s->nprimes = 1;
+    for (size_t k = 0; k < base.count && base.primes[k] <= r; ++k)
+        s->primes[s->nprimes++] = base.primes[k];
+    sieve_base_free(&base);
+    s->a = primes_upto(s, s->y);
+
+    for (long i = 2; i <= s->y; ++i)
+        if (!s->lpf[i])
+            for (long j = i; j <= s->y; j += i)
+                if (!s->lpf[j]) s->lpf[j] = (int)i;
+    s->lpf[1] = INT_MAX;
+    s->mu[1] = 1;
+    for (long m = 2; m <= s->y; ++m) {
+        long q = m / s->lpf[m];
+        s->mu[m] = q % s->lpf[m] ? -s->mu[q] : 0;
+    }
+    return 0;
+}
+
+void pi_split_free(PiSplit* s) {
+    free(s->primes);
+    free(s->mu);
+    free(s->lpf);
+}
+
+long pi_split_segments(const PiSplit* s) {
+    return (s->limit + PRIMECOUNT_SEGMENT - 1) / PRIMECOUNT_SEGMENT;
+}
+
+long pi_split_ordinary(const PiSplit* s) {
+    // the ordinary leaves mu(m) phi(x / m, 0) for m <= y, and a - 1
+    long sum = s->a - 1;
+    for (long m = 1; m <= s->y; ++m) sum += s->mu[m] * (s->x / m);
+    return sum;
+}
+
+static void tree_remove(int* tree, long len, long i) {
+    // fenwick tree over the segment, i counted from 1
+    for (; i <= len; i += i & -i) --tree[i];
+}
+
+static long tree_count(const int* tree, long i) {
+    // numbers left in the first i of the segment
+    long count = 0;
+    for (; i > 0; i -= i & -i) count += tree[i];
+    return count;
+}
+
+int pi_split_block(const PiSplit* s, long first, long segments, long* counts,
+                   long* weights, long* sum) {
+    // segments from first on, counts[b] = numbers left in them after
+    // crossing off b primes, weights and sum as in primecount.h, arrays of
+    // a + 1, 1 if out of memory
+    long x = s->x, y = s->y, a = s->a;
+    for (long b = 0; b <= a; ++b) counts[b] = weights[b] = 0;
+    *sum = 0;
+    long lo = 1 + first * PRIMECOUNT_SEGMENT;
+    long end = lo + segments * PRIMECOUNT_SEGMENT;
+    if (end > s->limit + 1) end = s->limit + 1;
+    if (lo >= end) return 0;
+    unsigned char* left = (unsigned char*)malloc(PRIMECOUNT_SEGMENT);
+    int* tree = (int*)malloc((PRIMECOUNT_SEGMENT + 1) * sizeof(int));
+    if (!left || !tree) {
+        free(left);
+        free(tree);
+        return 1;
+    }
+
+    for (long seg_lo = lo; seg_lo < end; seg_lo += PRIMECOUNT_SEGMENT) {
+        long seg_hi = seg_lo + PRIMECOUNT_SEGMENT;
+        if (seg_hi > end) seg_hi = end;
+        long len = seg_hi - seg_lo;
+        memset(left, 1, (size_t)len);
+        for (long i = 1; i <= len; ++i) tree[i] = (int)(i & -i);
+        long remaining = len;
+        // past the last b with a leaf in here the tree isn't read again
+        long last_leaf = -1;
+        for (long b = 0; b < a; ++b) {
+            long p = s->primes[b];
+            if (y / p < x / (p * seg_lo) && x / (p * seg_hi) < y) last_leaf = b;
+        }
+
+        for (long b = 0; b <= a; ++b) {
+            if (b < a) {
+                // m in (y / p, y] with x / (m p) in [seg_lo, seg_hi)
+                long p = s->primes[b];
+                long m_lo = x / (p * seg_hi);
+                if (m_lo < y / p) m_lo = y / p;
+                long m_hi = x / (p * seg_lo);
+                if (m_hi > y) m_hi = y;
+                for (long m = m_lo + 1; m <= m_hi; ++m) {
+                    if (!s->mu[m] || s->lpf[m] <= p) continue;
+                    long z = x / (m * p);
+                    *sum -= s->mu[m] *
+                            (counts[b] + tree_count(tree, z - seg_lo + 1));
+                    weights[b] -= s->mu[m];
+                }
+            } else {
+                // P2, p descending so x / p ascends and one pass counts
+                long p_lo = x / seg_hi > y ? x / seg_hi : y;
+                long p_hi = x / seg_lo;
+                long k_hi = primes_upto(s, p_hi);
+                long k_lo = primes_upto(s, p_lo);
+                long at = seg_lo, seen = 0;
+                for (long k = k_hi; k > k_lo; --k) {
+                    long z = x / s->primes[k - 1];
+                    for (; at <= z; ++at) seen += left[at - seg_lo];
+                    *sum -= counts[a] + seen + a - k;
+                    --weights[a];
+                }
+            }
+            counts[b] += remaining;
+            if (b == a) break;
+
+            long p = s->primes[b];
+            long first_multiple = (seg_lo + p - 1) / p * p;
+            for (long j = first_multiple - seg_lo; j < len; j += p) {
+                if (!left[j]) continue;
+                left[j] = 0;
+                --remaining;
+                if (b < last_leaf) tree_remove(tree, len, j + 1);
+            }
+        }
+    }
+    free(left);
+    free(tree);
+    return 0;
+}
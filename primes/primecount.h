@@ -0,0 +1,44 @@
+#ifndef PRIMECOUNT_H_INCLUDED
+#define PRIMECOUNT_H_INCLUDED
+
+// stages touching fewer values than this run on one thread, splitting them
+// costs more in barriers than it saves
+#define PRIMECOUNT_PARALLEL_MIN 32768
+
+// x / d can be done in double below this
+#define PRIMECOUNT_DOUBLE_LIMIT (1L << 53)
+
+// numbers per segment of the split count's sieve, one byte and one int each
+#define PRIMECOUNT_SEGMENT 65536
+// y = PRIMECOUNT_ALPHA x^(1/3), bigger trades sieving for more leaves
+#define PRIMECOUNT_ALPHA 2
+
+// pi(x) split into pieces that can be counted anywhere and added up, for
+// spreading over MPI ranks (Lagarias-Miller-Odlyzko):
+//   pi(x) = ordinary + a - 1 + the special leaves - P2
+// where a = pi(y), y >= x^(1/3), and both the special leaves and P2 only
+// need counts of 1..z left after crossing off the first b primes for z up to
+// x / y, which a sieve of [1, x / y] gives one segment at a time
+// a run of segments adds sum + weights[b] * counts[b] of everything before it
+// for b = 0..a, so each run is independent once those counts are prefix
+// summed
+typedef struct {
+    long x;
+    long y;
+    long limit;       // x / y, the top of the sieved range
+    long a;           // primes <= y
+    long* primes;     // primes[k] = p_(k+1), every prime <= sqrt x
+    long nprimes;
+    signed char* mu;  // mobius function of m <= y
+    int* lpf;         // least prime factor of m <= y
+} PiSplit;
+
+long prime_pi(long, int);
+
+int pi_split_init(PiSplit*, long);
+long pi_split_segments(const PiSplit*);
+long pi_split_ordinary(const PiSplit*);
+int pi_split_block(const PiSplit*, long, long, long*, long*, long*);
+void pi_split_free(PiSplit*);
+
+#endif
@@ -0,0 +1,288 @@
+#include "primeindex.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sieve.h"
+#include "workqueue.h"
+
+typedef struct {
+    int id;
+    long limit;
+    long first_chunk;  // queue ids are relative to the old end of the index
+    const SieveBase* base;
+    WorkQueue* queue;
+    uint64_t* bits;
+    int failed;
+} ExtendInfo;
+
+static int index_map(PrimeIndex* idx) {
+    // map the whole file and check every region fits inside it
+    struct stat st;
+    if (fstat(idx->fd, &st) || (size_t)st.st_size < PRIMEINDEX_BITS_OFFSET)
+        return 1;
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+                     idx->fd, 0);
+    if (map == MAP_FAILED) return 1;
+    idx->map = (unsigned char*)map;
+    idx->map_len = (size_t)st.st_size;
+    const PrimeIndexHeader* h = (const PrimeIndexHeader*)map;
+    if (memcmp(h->magic, PRIMEINDEX_MAGIC, sizeof(h->magic)) ||
+        h->version != PRIMEINDEX_VERSION || !h->block_words ||
+        h->nwords != h->nblocks * h->block_words ||
+        h->limit != 1 + h->nwords * BITSET_WORD_SPAN ||
+        h->bits_offset + h->nwords * sizeof(uint64_t) > h->prefix_offset ||
+        h->prefix_offset > idx->map_len ||
+        h->nblocks + 1 > (idx->map_len - h->prefix_offset) / sizeof(uint64_t)) {
+        munmap(map, idx->map_len);
+        idx->map = NULL;
+        return 1;
+    }
+    idx->header = h;
+    idx->bits = (const uint64_t*)(idx->map + h->bits_offset);
+    idx->prefix = (const uint64_t*)(idx->map + h->prefix_offset);
+    return 0;
+}
+
+int prime_index_open(PrimeIndex* idx, const char* filename, int threads) {
+    // threads > 0 lets queries past the limit grow the file
+    memset(idx, 0, sizeof(*idx));
+    idx->threads = threads;
+    idx->fd = open(filename, threads > 0 ? O_RDWR : O_RDONLY);
+    if (idx->fd == -1) return 1;
+    if (index_map(idx)) {
+        close(idx->fd);
+        return 1;
+    }
+    return 0;
+}
+
+void prime_index_close(PrimeIndex* idx) {
+    if (idx->map) munmap(idx->map, idx->map_len);
+    if (idx->fd != -1) close(idx->fd);
+    idx->map = NULL;
+    idx->fd = -1;
+}
+
+int prime_index_build(const char* filename, long limit, int threads) {
+    // start from an empty index and extend it like any other
+    int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return 1;
+    PrimeIndexHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PRIMEINDEX_MAGIC, sizeof(h.magic));
+    h.version = PRIMEINDEX_VERSION;
+    h.limit = 1;
+    h.block_words = PRIMEINDEX_BLOCK_WORDS;
+    h.bits_offset = h.prefix_offset = PRIMEINDEX_BITS_OFFSET;
+    uint64_t zero = 0;
+    int failed = ftruncate(fd, PRIMEINDEX_BITS_OFFSET + sizeof(zero)) ||
+                 pwrite(fd, &h, sizeof(h), 0) != sizeof(h) ||
+                 pwrite(fd, &zero, sizeof(zero), PRIMEINDEX_BITS_OFFSET) !=
+                     sizeof(zero);
+    close(fd);
+    if (failed) return 1;
+
+    PrimeIndex idx;
+    if (prime_index_open(&idx, filename, threads > 0 ? threads : 1)) return 1;
+    failed = prime_index_extend(&idx, limit);
+    prime_index_close(&idx);
+    return failed;
+}
+
+static void* extend_thread(void* arg) {
+    ExtendInfo* info = (ExtendInfo*)arg;
+    long chunk, lo, hi;
+    int stolen;
+    while (workqueue_take(info->queue, info->id, &chunk, &stolen)) {
+        chunk += info->first_chunk;
+        work_chunk_range(info->limit, chunk, &lo, &hi);
+        if (sieve_bits(info->base, lo, hi,
+                       info->bits + chunk * WORK_CHUNK_WORDS)) {
+            info->failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+int prime_index_extend(PrimeIndex* idx, long limit) {
+    // grow the index to cover every prime < limit, only new chunks are
+    // sieved, earlier bits and prefix counts are kept as they are
+    // not safe against another process extending the same file
+    if (idx->threads < 1) return 1;
+    const PrimeIndexHeader* h = idx->header;
+    long old_chunks = (long)(h->nwords / WORK_CHUNK_WORDS);
+    long chunks = work_chunks_for(limit);
+    if (chunks <= old_chunks) return 0;
+
+    uint64_t old_nblocks = h->nblocks;
+    uint64_t nwords = (uint64_t)chunks * WORK_CHUNK_WORDS;
+    uint64_t nblocks = nwords / PRIMEINDEX_BLOCK_WORDS;
+    uint64_t prefix_offset = PRIMEINDEX_BITS_OFFSET + nwords * sizeof(uint64_t);
+    size_t size = prefix_offset + (nblocks + 1) * sizeof(uint64_t);
+    // new bits land where the old counts are, so keep those aside
+    uint64_t* old_prefix =
+        (uint64_t*)malloc((old_nblocks + 1) * sizeof(uint64_t));
+    if (!old_prefix) return 1;
+    memcpy(old_prefix, idx->prefix, (old_nblocks + 1) * sizeof(uint64_t));
+    munmap(idx->map, idx->map_len);
+    idx->map = NULL;
+
+    unsigned char* map = MAP_FAILED;
+    if (!ftruncate(idx->fd, (off_t)size))
+        map = (unsigned char*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, idx->fd, 0);
+    if (map == MAP_FAILED) {
+        free(old_prefix);
+        return 1;
+    }
+    uint64_t* bits = (uint64_t*)(map + PRIMEINDEX_BITS_OFFSET);
+    uint64_t* prefix = (uint64_t*)(map + prefix_offset);
+
+    // whole chunks only, so the file limit is past the one asked for
+    long full_limit = 1 + chunks * WORK_CHUNK_SPAN;
+    SieveBase base;
+    WorkQueue queue;
+    int threads = idx->threads;
+    int failed = sieve_base_init(&base, full_limit);
+    if (!failed && workqueue_init(&queue, chunks - old_chunks, threads)) {
+        sieve_base_free(&base);
+        failed = 1;
+    }
+    if (!failed) {
+        pthread_t tid[threads];
+        ExtendInfo infos[threads];
+        for (int i = 0; i < threads; ++i) {
+            infos[i].id = i;
+            infos[i].limit = full_limit;
+            infos[i].first_chunk = old_chunks;
+            infos[i].base = &base;
+            infos[i].queue = &queue;
+            infos[i].bits = bits;
+            infos[i].failed = 0;
+            pthread_create(&tid[i], NULL, extend_thread, &infos[i]);
+        }
+        for (int i = 0; i < threads; ++i) {
+            pthread_join(tid[i], NULL);
+            failed |= infos[i].failed;
+        }
+        sieve_base_free(&base);
+        workqueue_free(&queue);
+    }
+
+    // header is only rewritten once bits and counts are all there
+    PrimeIndexHeader* header = (PrimeIndexHeader*)map;
+    memcpy(prefix, old_prefix, (old_nblocks + 1) * sizeof(uint64_t));
+    if (!failed) {
+        for (uint64_t b = old_nblocks; b < nblocks; ++b)
+            prefix[b + 1] =
+                prefix[b] + bitset_popcount(bits + b * PRIMEINDEX_BLOCK_WORDS,
+                                            PRIMEINDEX_BLOCK_WORDS);
+        header->limit = (uint64_t)full_limit;
+        header->count = prefix[nblocks] + 1;  // and 2
+        header->nwords = nwords;
+        header->nblocks = nblocks;
+        header->prefix_offset = prefix_offset;
+    } else {
+        // old header still describes the start of the file, put its counts
+        // back where it expects them
+        memcpy(map + header->prefix_offset, old_prefix,
+               (old_nblocks + 1) * sizeof(uint64_t));
+    }
+    free(old_prefix);
+    munmap(map, size);
+    return index_map(idx) || failed;
+}
+
+static int index_cover(PrimeIndex* idx, uint64_t x) {
+    // make sure x is inside the index, at least doubling it when it grows
+    // so a run of increasing queries only extends a few times
+    if (x < idx->header->limit) return 0;
+    uint64_t limit = x + 1;
+    if (limit < 2 * idx->header->limit) limit = 2 * idx->header->limit;
+    return prime_index_extend(idx, (long)limit) || x >= idx->header->limit;
+}
+
+static uint64_t odd_rank(const PrimeIndex* idx, uint64_t k) {
+    // odd primes among bits [0, k)
+    uint64_t w = k / 64;
+    uint64_t b = w / idx->header->block_words;
+    uint64_t block_start = b * idx->header->block_words;
+    uint64_t count = idx->prefix[b] +
+                     bitset_popcount(idx->bits + block_start, w - block_start);
+    if (k % 64)
+        count += (uint64_t)__builtin_popcountll(idx->bits[w] &
+                                                ((1ULL << (k % 64)) - 1));
+    return count;
+}
+
+int prime_index_is_prime(PrimeIndex* idx, uint64_t x) {
+    // 1 prime, 0 not, -1 past the index and it couldn't grow
+    if (x < 3 || x % 2 == 0) return x == 2;
+    if (index_cover(idx, x)) return -1;
+    uint64_t k = (x - 1) / 2;
+    return (int)(idx->bits[k / 64] >> (k % 64) & 1);
+}
+
+long prime_index_pi(PrimeIndex* idx, uint64_t x) {
+    // primes <= x, -1 past the index and it couldn't grow
+    if (x < 2) return 0;
+    if (index_cover(idx, x)) return -1;
+    return 1 + (long)odd_rank(idx, (x + 1) / 2);
+}
+
+long prime_index_next(PrimeIndex* idx, uint64_t x) {
+    // smallest prime > x, -1 past the index and it couldn't grow
+    if (x < 2) return 2;
+    uint64_t k = (x + 1) / 2;  // bit of the first odd number > x
+    for (;;) {
+        if (index_cover(idx, 2 * k + 1)) return -1;
+        uint64_t nwords = idx->header->nwords;
+        uint64_t w = k / 64;
+        uint64_t bits = idx->bits[w] & (~0ULL << (k % 64));
+        while (!bits && ++w < nwords) bits = idx->bits[w];
+        if (bits) return (long)(2 * (w * 64 + __builtin_ctzll(bits)) + 1);
+        k = nwords * 64;
+    }
+}
+
+long prime_index_range(PrimeIndex* idx, uint64_t a, uint64_t b,
+                       uint64_t* out, size_t max) {
+    // primes in [a, b], the first max of them go to out, returns how many
+    // there are in total, -1 past the index and it couldn't grow
+    if (b < 2 || a > b) return 0;
+    if (index_cover(idx, b)) return -1;
+    long total = prime_index_pi(idx, b) - (a ? prime_index_pi(idx, a - 1) : 0);
+    size_t found = 0;
+    if (a <= 2 && found < max) out[found++] = 2;
+
+    uint64_t k = a / 2;  // first odd number >= a
+    uint64_t k_end = (b + 1) / 2;  // first odd number > b
+    for (uint64_t w = k / 64; found < max && w * 64 < k_end; ++w) {
+        uint64_t bits = idx->bits[w];
+        if (w == k / 64) bits &= ~0ULL << (k % 64);
+        if (w == k_end / 64) bits &= (1ULL << (k_end % 64)) - 1;
+        while (bits && found < max) {
+            out[found++] = 2 * (w * 64 + __builtin_ctzll(bits)) + 1;
+            bits &= bits - 1;
+        }
+    }
+    return total;
+}
+
+int prime_index_bitset(PrimeIndex* idx, long n, PrimeBitset* bs) {
+    // copy of the bits for every odd prime < n, like a fresh sieve would
+    // give, so the existing writers can be used unchanged
+    if (n > 1 && index_cover(idx, (uint64_t)n - 1)) return 1;
+    if (bitset_init(bs, 1, n)) return 1;
+    memcpy(bs->words, idx->bits, bs->nwords * sizeof(uint64_t));
+    if (bs->nbits % BITSET_WORD_BITS)
+        bs->words[bs->nwords - 1] &= (1ULL << (bs->nbits % BITSET_WORD_BITS)) - 1;
+    return 0;
+}
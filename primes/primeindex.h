@@ -0,0 +1,51 @@
+#ifndef PRIMEINDEX_H_INCLUDED
+#define PRIMEINDEX_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitset.h"
+
+// persistent sieve for repeated queries:
+//   header, padded to a page
+//   bitmap, bit k set iff 2k + 1 is prime, always whole work chunks
+//   nblocks + 1 counts, odd primes before each block of the bitmap
+// so pi(x) is a prefix lookup plus at most one block of popcounts
+#define PRIMEINDEX_MAGIC "PRIMEIDX"
+#define PRIMEINDEX_VERSION 1
+#define PRIMEINDEX_BLOCK_WORDS 512
+#define PRIMEINDEX_BITS_OFFSET 4096
+
+typedef struct {
+    char magic[8];
+    uint64_t version;
+    uint64_t limit;  // every prime < limit is indexed
+    uint64_t count;  // primes < limit, including 2
+    uint64_t nwords;
+    uint64_t block_words;
+    uint64_t nblocks;
+    uint64_t bits_offset;
+    uint64_t prefix_offset;
+} PrimeIndexHeader;
+
+typedef struct {
+    int fd;
+    int threads;  // sieve threads for extending, 0 = never extend
+    unsigned char* map;
+    size_t map_len;
+    const PrimeIndexHeader* header;
+    const uint64_t* bits;
+    const uint64_t* prefix;
+} PrimeIndex;
+
+int prime_index_build(const char*, long, int);
+int prime_index_open(PrimeIndex*, const char*, int);
+void prime_index_close(PrimeIndex*);
+int prime_index_extend(PrimeIndex*, long);
+int prime_index_is_prime(PrimeIndex*, uint64_t);
+long prime_index_pi(PrimeIndex*, uint64_t);
+long prime_index_next(PrimeIndex*, uint64_t);
+long prime_index_range(PrimeIndex*, uint64_t, uint64_t, uint64_t*, size_t);
+int prime_index_bitset(PrimeIndex*, long, PrimeBitset*);
+
+#endif
@@ -0,0 +1,219 @@
+#include "primeio.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// "00" "01" ... "99", two digits per division instead of one
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+typedef struct {
+    int id;
+    int threads;
+    int fd;
+    const PrimeBitset* bs;
+    pthread_barrier_t* barrier;
+    // shared between threads, indexed by thread id
+    size_t* lens;
+    off_t* offsets;
+    off_t* file_len;
+    int failed;  // this thread's, ored together once they're joined
+    char* buf;
+    size_t capacity;
+} WriterInfo;
+
+int format_u64(uint64_t v, char* out) {
+    // write digits right to left into tmp then copy out
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        unsigned r = (unsigned)(v % 100);
+        v /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * r, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * v, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    int len = (int)(tmp + sizeof(tmp) - p);
+    memcpy(out, p, (size_t)len);
+    return len;
+}
+
+size_t format_primes(const uint64_t* words, size_t nwords, long lo,
+                     char* out) {
+    // one prime per line, out needs popcount * MAX_LINE_BYTES bytes
+    char* p = out;
+    for (size_t w = 0; w < nwords; ++w) {
+        uint64_t bits = words[w];
+        long base = lo + (long)w * BITSET_WORD_SPAN;
+        while (bits) {
+            p += format_u64((uint64_t)(base + 2 * __builtin_ctzll(bits)), p);
+            *p++ = '\n';
+            bits &= bits - 1;
+        }
+    }
+    return (size_t)(p - out);
+}
+
+static int decimal_digits(long v) {
+    int digits = 1;
+    while (v >= 10) {
+        v /= 10;
+        ++digits;
+    }
+    return digits;
+}
+
+size_t formatted_length(const uint64_t* words, size_t nwords, long lo) {
+    // bytes format_primes would produce, without formatting anything
+    size_t len = 0;
+    for (size_t w = 0; w < nwords; ++w) {
+        uint64_t bits = words[w];
+        long base = lo + (long)w * BITSET_WORD_SPAN;
+        int digits = decimal_digits(base);
+        if (digits == decimal_digits(base + BITSET_WORD_SPAN - 2)) {
+            // whole word has the same number of digits, just popcount
+            len += (size_t)__builtin_popcountll(bits) * (digits + 1);
+            continue;
+        }
+        // word straddles a power of 10
+        while (bits) {
+            len += decimal_digits(base + 2 * __builtin_ctzll(bits)) + 1;
+            bits &= bits - 1;
+        }
+    }
+    return len;
+}
+
+static int write_all(int fd, const char* buf, size_t len, off_t offset) {
+    while (len) {
+        ssize_t w = pwrite(fd, buf, len, offset);
+        if (w <= 0) return 1;
+        buf += w;
+        len -= (size_t)w;
+        offset += w;
+    }
+    return 0;
+}
+
+static void* writer_thread(void* arg) {
+    WriterInfo* info = (WriterInfo*)arg;
+    const PrimeBitset* bs = info->bs;
+    size_t round_words = (size_t)info->threads * WRITE_SLICE_WORDS;
+
+    for (size_t round = 0; round < bs->nwords; round += round_words) {
+        // this thread's slice of the round, slices are in ascending order
+        size_t w_lo = round + (size_t)info->id * WRITE_SLICE_WORDS;
+        size_t w_hi = w_lo + WRITE_SLICE_WORDS;
+        if (w_lo > bs->nwords) w_lo = bs->nwords;
+        if (w_hi > bs->nwords) w_hi = bs->nwords;
+        // size the buffer off the popcount rather than the worst case
+        size_t need =
+            bitset_popcount(bs->words + w_lo, w_hi - w_lo) * MAX_LINE_BYTES;
+        if (need > info->capacity) {
+            char* grown = (char*)realloc(info->buf, need);
+            if (grown) {
+                info->buf = grown;
+                info->capacity = need;
+            }
+        }
+        if (need > info->capacity) {
+            // can't bail out early, the others would hang at the barrier
+            info->failed = 1;
+            info->lens[info->id] = 0;
+        } else {
+            info->lens[info->id] = format_primes(
+                bs->words + w_lo, w_hi - w_lo,
+                bs->lo + (long)w_lo * BITSET_WORD_SPAN, info->buf);
+        }
+        pthread_barrier_wait(info->barrier);
+
+        // exclusive prefix sum of byte lengths gives each slice's offset
+        if (info->id == 0) {
+            for (int i = 0; i < info->threads; ++i) {
+                info->offsets[i] = *info->file_len;
+                *info->file_len += (off_t)info->lens[i];
+            }
+        }
+        pthread_barrier_wait(info->barrier);
+
+        if (write_all(info->fd, info->buf, info->lens[info->id],
+                      info->offsets[info->id]))
+            info->failed = 1;
+        // buffers and lens get reused next round
+        pthread_barrier_wait(info->barrier);
+    }
+    return NULL;
+}
+
+int write_primes_file(const PrimeBitset* bs, int include_two, int threads,
+                      const char* filename) {
+    // every thread formats its own slice and pwrites it at the right offset,
+    // so the file comes out sorted without a single fprintf
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) return 1;
+    if (threads < 1) threads = 1;
+
+    off_t file_len = 0;
+    int failed = 0;
+    if (include_two) {
+        failed |= write_all(fd, "2\n", 2, 0);
+        file_len = 2;
+    }
+
+    pthread_t* tid = (pthread_t*)malloc(threads * sizeof(*tid));
+    WriterInfo* infos = (WriterInfo*)malloc(threads * sizeof(*infos));
+    size_t* lens = (size_t*)malloc(threads * sizeof(*lens));
+    off_t* offsets = (off_t*)malloc(threads * sizeof(*offsets));
+    if (!tid || !infos || !lens || !offsets) {
+        free(tid);
+        free(infos);
+        free(lens);
+        free(offsets);
+        close(fd);
+        return 1;
+    }
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, (unsigned)threads);
+
+    for (int i = 0; i < threads; ++i) {
+        infos[i].id = i;
+        infos[i].threads = threads;
+        infos[i].fd = fd;
+        infos[i].bs = bs;
+        infos[i].barrier = &barrier;
+        infos[i].lens = lens;
+        infos[i].offsets = offsets;
+        infos[i].file_len = &file_len;
+        infos[i].failed = 0;
+        infos[i].buf = NULL;
+        infos[i].capacity = 0;
+    }
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&tid[i], NULL, writer_thread, &infos[i]);
+    for (int i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+
+    pthread_barrier_destroy(&barrier);
+    for (int i = 0; i < threads; ++i) {
+        failed |= infos[i].failed;
+        free(infos[i].buf);
+    }
+    free(tid);
+    free(infos);
+    free(lens);
+    free(offsets);
+    if (close(fd)) failed = 1;
+    return failed;
+}
@@ -0,0 +1,20 @@
+#ifndef PRIMEIO_H_INCLUDED
+#define PRIMEIO_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitset.h"
+
+// words each writer thread formats per round, caps buffer memory at about
+// threads * primes in a slice * 21 bytes no matter how big the file is
+#define WRITE_SLICE_WORDS 65536
+// longest decimal line for a 64 bit value plus newline
+#define MAX_LINE_BYTES 21
+
+int format_u64(uint64_t, char*);
+size_t format_primes(const uint64_t*, size_t, long, char*);
+size_t formatted_length(const uint64_t*, size_t, long);
+int write_primes_file(const PrimeBitset*, int, int, const char*);
+
+#endif
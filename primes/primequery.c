@@ -0,0 +1,117 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "primeindex.h"
+
+// primes listed per batch for range queries
+#define RANGE_BATCH 4096
+
+int parse_u64(const char* str, uint64_t* out);
+double elapsed_us(const struct timespec* start);
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printf(
+            "Usage: %s file build n\n"
+            "       %s file info\n"
+            "       %s file isprime x\n"
+            "       %s file pi x          (primes <= x)\n"
+            "       %s file next x        (first prime > x)\n"
+            "       %s file range a b     (primes in [a, b])\n"
+            "queries past the end of the index extend it\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return 1;
+    }
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t x, y;
+    struct timespec start;
+
+    if (!strcmp(argv[2], "build")) {
+        if (argc != 4 || parse_u64(argv[3], &x)) {
+            printf("Couldn't parse to a number\n");
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (prime_index_build(argv[1], (long)x, threads)) {
+            printf("Couldn't build index: %s\n", argv[1]);
+            return 1;
+        }
+        printf("Built in %.3f s\n", elapsed_us(&start) / 1e6);
+        return 0;
+    }
+
+    PrimeIndex idx;
+    if (prime_index_open(&idx, argv[1], threads)) {
+        printf("Couldn't open index: %s\n", argv[1]);
+        return 1;
+    }
+    int status = 0;
+    long result = 0;
+
+    if (!strcmp(argv[2], "info")) {
+        printf("Primes: %" PRIu64 "\n", idx.header->count);
+        printf("Limit: %" PRIu64 "\n", idx.header->limit);
+        printf("Blocks: %" PRIu64 " of %" PRIu64 " words\n",
+               idx.header->nblocks, idx.header->block_words);
+        printf("File size: %zu bytes\n", idx.map_len);
+    } else if (argc == 4 && !parse_u64(argv[3], &x) &&
+               (!strcmp(argv[2], "isprime") || !strcmp(argv[2], "pi") ||
+                !strcmp(argv[2], "next"))) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!strcmp(argv[2], "isprime"))
+            result = prime_index_is_prime(&idx, x);
+        else if (!strcmp(argv[2], "pi"))
+            result = prime_index_pi(&idx, x);
+        else
+            result = prime_index_next(&idx, x);
+        double us = elapsed_us(&start);
+        if (result < 0) {
+            printf("Couldn't extend index to %" PRIu64 "\n", x);
+            status = 1;
+        } else if (!strcmp(argv[2], "isprime")) {
+            printf("%" PRIu64 " is %s (%.3f us)\n", x,
+                   result ? "prime" : "not prime", us);
+        } else {
+            printf("%ld (%.3f us)\n", result, us);
+        }
+    } else if (!strcmp(argv[2], "range") && argc == 5 &&
+               !parse_u64(argv[3], &x) && !parse_u64(argv[4], &y)) {
+        uint64_t batch[RANGE_BATCH];
+        // a batch at a time, each picking up after the last prime printed
+        while (x <= y) {
+            result = prime_index_range(&idx, x, y, batch, RANGE_BATCH);
+            if (result < 0) {
+                printf("Couldn't extend index to %" PRIu64 "\n", y);
+                status = 1;
+                break;
+            }
+            size_t got = result < RANGE_BATCH ? (size_t)result : RANGE_BATCH;
+            for (size_t i = 0; i < got; ++i) printf("%" PRIu64 "\n", batch[i]);
+            if (got < RANGE_BATCH) break;
+            x = batch[got - 1] + 1;
+        }
+    } else {
+        printf("Unknown command: %s\n", argv[2]);
+        status = 1;
+    }
+
+    prime_index_close(&idx);
+    return status;
+}
+
+int parse_u64(const char* str, uint64_t* out) {
+    char* ptr;
+    *out = strtoull(str, &ptr, 10);
+    return ptr == str;
+}
+
+double elapsed_us(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 +
+           (now.tv_nsec - start->tv_nsec) / 1e3;
+}
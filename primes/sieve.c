@@ -0,0 +1,109 @@
+#include "sieve.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "presieve.h"
+
+long isqrt(long n) {
+    // floating point sqrt can be off by one for large n, fix it up
+    long r = (long)sqrt((double)n);
+    while (r * r > n) --r;
+    while ((r + 1) * (r + 1) <= n) ++r;
+    return r;
+}
+
+int sieve_base_init(SieveBase* base, long n) {
+    // every composite < n has a prime factor <= sqrt(n)
+    long limit = isqrt(n) + 1;
+    base->limit = limit;
+    base->count = 0;
+    base->primes = NULL;
+
+    // plain sieve, one byte per number, small enough to not matter
+    unsigned char* composite = (unsigned char*)calloc((size_t)limit + 1, 1);
+    if (!composite) return 1;
+    for (long i = 3; i * i <= limit; i += 2)
+        if (!composite[i])
+            for (long j = i * i; j <= limit; j += 2 * i) composite[j] = 1;
+
+    size_t count = 0;
+    for (long i = 3; i <= limit; i += 2) count += !composite[i];
+    base->primes = (long*)malloc((count ? count : 1) * sizeof(long));
+    if (!base->primes) {
+        free(composite);
+        return 1;
+    }
+    for (long i = 3; i <= limit; i += 2)
+        if (!composite[i]) base->primes[base->count++] = i;
+
+    free(composite);
+    return 0;
+}
+
+void sieve_base_free(SieveBase* base) {
+    free(base->primes);
+    base->primes = NULL;
+    base->count = 0;
+}
+
+void sieve_init_next(const SieveBase* base, long lo, long* next) {
+    // next[i] = first odd multiple of primes[i] that still needs crossing off
+    // at or after lo, multiples below p*p were crossed off by smaller primes
+    for (size_t i = 0; i < base->count; ++i) {
+        long p = base->primes[i];
+        long start = p * p;
+        if (start < lo) {
+            start = (lo + p - 1) / p * p;
+            if (!(start & 1)) start += p;
+        }
+        next[i] = start;
+    }
+}
+
+void sieve_segment(const SieveBase* base, long* next, long lo, long hi,
+                   uint64_t* words) {
+    // bit k of words is set iff lo + 2k is prime, lo must be odd
+    long nbits = (hi - lo + 1) / 2;
+    long nwords = (nbits + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+    // smallest primes come from copied tiles and patterns, not crossing off
+    long done_below = presieve_fill(words, lo, hi, (size_t)nwords);
+    // padding bits past hi must read as not prime
+    if (nbits % BITSET_WORD_BITS)
+        words[nwords - 1] &= (1ULL << (nbits % BITSET_WORD_BITS)) - 1;
+    if (lo == 1) words[0] &= ~1ULL;  // 1 isn't prime
+
+    for (size_t i = 0; i < base->count; ++i) {
+        long p = base->primes[i];
+        if (p < done_below) continue;  // next[] is never read for these
+        if (p * p >= hi) break;  // untouched next[] still valid for later
+        long k = (next[i] - lo) / 2;
+        for (; k < nbits; k += p) words[k / 64] &= ~(1ULL << (k % 64));
+        next[i] = lo + 2 * k;
+    }
+}
+
+int sieve_bits(const SieveBase* base, long lo, long hi, uint64_t* words) {
+    // sieve [lo, hi) one segment at a time, lo odd and word aligned output
+    long* next = (long*)malloc((base->count ? base->count : 1) * sizeof(long));
+    if (!next) return 1;
+    sieve_init_next(base, lo, next);
+    for (; lo < hi; lo += SIEVE_SEGMENT_SPAN) {
+        long seg_hi = lo + SIEVE_SEGMENT_SPAN < hi ? lo + SIEVE_SEGMENT_SPAN : hi;
+        sieve_segment(base, next, lo, seg_hi, words);
+        words += SIEVE_SEGMENT_WORDS;
+    }
+    free(next);
+    return 0;
+}
+
+void sieve_partition(long n, long part, long parts, long* lo, long* hi) {
+    // split the odd numbers in [1, n) into parts contiguous blocks of whole
+    // segments, so blocks never share a word of a bitset starting at 1
+    long segments = (n - 1 + SIEVE_SEGMENT_SPAN - 1) / SIEVE_SEGMENT_SPAN;
+    *lo = 1 + segments * part / parts * SIEVE_SEGMENT_SPAN;
+    *hi = 1 + segments * (part + 1) / parts * SIEVE_SEGMENT_SPAN;
+    if (*lo > n) *lo = n;
+    if (*hi > n) *hi = n;
+}
@@ -0,0 +1,28 @@
+#ifndef SIEVE_H_INCLUDED
+#define SIEVE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bitset.h"
+
+// words per segment (one bit per odd number), 32KB to stay in L1/L2
+#define SIEVE_SEGMENT_WORDS 4096
+// numbers covered by one segment
+#define SIEVE_SEGMENT_SPAN (BITSET_WORD_SPAN * SIEVE_SEGMENT_WORDS)
+
+typedef struct {
+    long limit;     // every odd prime <= limit is in primes
+    long* primes;   // odd primes in ascending order, starting at 3
+    size_t count;
+} SieveBase;
+
+int sieve_base_init(SieveBase*, long);
+void sieve_base_free(SieveBase*);
+long isqrt(long);
+void sieve_init_next(const SieveBase*, long, long*);
+void sieve_segment(const SieveBase*, long*, long, long, uint64_t*);
+int sieve_bits(const SieveBase*, long, long, uint64_t*);
+void sieve_partition(long, long, long, long*, long*);
+
+#endif
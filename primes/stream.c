@@ -0,0 +1,232 @@
+#include "stream.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "archive.h"
+#include "bitset.h"
+#include "primeio.h"
+#include "sieve.h"
+
+// producers sieve (and format) consecutive chunks into a ring of slots,
+// the writer drains the ring strictly in chunk order, so the output is
+// sorted and nothing bigger than the ring is ever held in memory
+// chunk k lives in slot k % slots, a producer may only fill it once the
+// writer is done with chunk k - slots
+// chunks are the work queue's unless two of those don't fit the budget,
+// then they're halved until two do
+
+typedef struct {
+    int ready;  // filled and waiting for the writer
+    uint64_t* words;
+    size_t count;
+    char* text;
+    size_t text_len;
+    size_t text_capacity;
+} StreamSlot;
+
+typedef struct {
+    long n;
+    long chunks;
+    size_t chunk_words;
+    int binary;
+    const SieveBase* base;
+    StreamSlot* slots;
+    long nslots;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;   // writer finished a chunk
+    pthread_cond_t slot_ready;  // producer filled a slot
+    // everything below is guarded by lock
+    long next_chunk;  // next chunk for a producer to claim
+    long written;     // chunks the writer has finished with
+    size_t bytes;     // slot memory allocated so far
+    int failed;
+} StreamState;
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void stream_fail(StreamState* s) {
+    pthread_mutex_lock(&s->lock);
+    s->failed = 1;
+    pthread_cond_broadcast(&s->slot_free);
+    pthread_cond_broadcast(&s->slot_ready);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void chunk_range(const StreamState* s, long chunk, long* lo,
+                        long* hi) {
+    long span = (long)s->chunk_words * BITSET_WORD_SPAN;
+    *lo = 1 + chunk * span;
+    *hi = *lo + span < s->n ? *lo + span : s->n;
+}
+
+static int fill_slot(StreamState* s, StreamSlot* slot, long chunk,
+                     size_t* grown) {
+    long lo, hi;
+    chunk_range(s, chunk, &lo, &hi);
+    if (!slot->words) {
+        slot->words = (uint64_t*)malloc(s->chunk_words * sizeof(uint64_t));
+        if (!slot->words) return 1;
+        *grown += s->chunk_words * sizeof(uint64_t);
+    }
+    if (sieve_bits(s->base, lo, hi, slot->words)) return 1;
+    size_t nwords = bitset_words_for(lo, hi);
+    slot->count = bitset_popcount(slot->words, nwords);
+    if (s->binary) return 0;
+
+    // text is exactly sized, slots only grow so the ring settles quickly
+    size_t need = formatted_length(slot->words, nwords, lo);
+    if (need > slot->text_capacity) {
+        char* text = (char*)realloc(slot->text, need);
+        if (!text) return 1;
+        *grown += need - slot->text_capacity;
+        slot->text = text;
+        slot->text_capacity = need;
+    }
+    slot->text_len = format_primes(slot->words, nwords, lo, slot->text);
+    return 0;
+}
+
+static void* producer_thread(void* arg) {
+    StreamState* s = (StreamState*)arg;
+    pthread_mutex_lock(&s->lock);
+    while (!s->failed && s->next_chunk < s->chunks) {
+        long chunk = s->next_chunk++;
+        StreamSlot* slot = &s->slots[chunk % s->nslots];
+        while (!s->failed && s->written <= chunk - s->nslots)
+            pthread_cond_wait(&s->slot_free, &s->lock);
+        if (s->failed) break;
+        pthread_mutex_unlock(&s->lock);
+
+        size_t grown = 0;
+        int failed = fill_slot(s, slot, chunk, &grown);
+
+        pthread_mutex_lock(&s->lock);
+        s->bytes += grown;
+        if (failed) {
+            s->failed = 1;
+            pthread_cond_broadcast(&s->slot_free);
+        }
+        slot->ready = 1;
+        pthread_cond_broadcast(&s->slot_ready);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+int stream_primes(long n, int threads, size_t budget, int binary,
+                  const char* filename, StreamStats* stats) {
+    // every prime < n to filename, text or archive, holding at most about
+    // budget bytes of chunks however big n is
+    StreamState s;
+    SieveBase base;
+    size_t word_bytes = sizeof(uint64_t) + (binary ? 0 : STREAM_TEXT_BOUND);
+    // one chunk being written while the next is sieved, or nothing overlaps
+    // halving keeps chunks whole words that evenly divide a sieve segment
+    s.chunk_words = WORK_CHUNK_WORDS;
+    while (s.chunk_words > 1 && budget < 2 * s.chunk_words * word_bytes)
+        s.chunk_words /= 2;
+    if (budget < 2 * s.chunk_words * word_bytes) {
+        printf("Memory budget too small, need at least %zu bytes\n",
+               2 * word_bytes);
+        return 1;
+    }
+    long span = (long)s.chunk_words * BITSET_WORD_SPAN;
+    s.n = n;
+    s.chunks = (n - 1 + span - 1) / span;
+    s.binary = binary;
+    s.base = &base;
+    s.nslots = (long)(budget / (s.chunk_words * word_bytes));
+    if (s.nslots > s.chunks) s.nslots = s.chunks > 0 ? s.chunks : 1;
+    s.next_chunk = s.written = 0;
+    s.bytes = 0;
+    s.failed = 0;
+    stats->count = n > 2 ? 1 : 0;
+    stats->slots = (size_t)s.nslots;
+    stats->chunk_words = s.chunk_words;
+    stats->write_time = stats->wait_time = 0;
+
+    FILE* fp = NULL;
+    ArchiveWriter w;
+    if (binary ? archive_writer_open(&w, filename)
+               : !(fp = fopen(filename, "w")))
+        return 1;
+    s.slots = (StreamSlot*)calloc((size_t)s.nslots, sizeof(*s.slots));
+    if (!s.slots || sieve_base_init(&base, n)) {
+        free(s.slots);
+        if (binary)
+            archive_writer_close(&w, (uint64_t)n);
+        else
+            fclose(fp);
+        return 1;
+    }
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.slot_free, NULL);
+    pthread_cond_init(&s.slot_ready, NULL);
+
+    pthread_t tid[threads];
+    for (int i = 0; i < threads; ++i)
+        pthread_create(&tid[i], NULL, producer_thread, &s);
+
+    // 2 isn't in the odd only bitset
+    int failed = 0;
+    if (n > 2) failed = binary ? archive_append(&w, 2) : fputs("2\n", fp) < 0;
+
+    // writer, on this thread, output of chunk k overlaps sieving of k + 1..
+    struct timespec start;
+    for (long k = 0; k < s.chunks && !failed; ++k) {
+        StreamSlot* slot = &s.slots[k % s.nslots];
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        pthread_mutex_lock(&s.lock);
+        while (!s.failed && !slot->ready)
+            pthread_cond_wait(&s.slot_ready, &s.lock);
+        failed = s.failed;
+        pthread_mutex_unlock(&s.lock);
+        stats->wait_time += seconds_since(&start);
+        if (failed) break;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        long lo, hi;
+        chunk_range(&s, k, &lo, &hi);
+        if (binary)
+            failed = archive_append_bits(&w, slot->words,
+                                         bitset_words_for(lo, hi), lo);
+        else
+            failed = fwrite(slot->text, 1, slot->text_len, fp) !=
+                     slot->text_len;
+        stats->count += (long)slot->count;
+        stats->write_time += seconds_since(&start);
+
+        pthread_mutex_lock(&s.lock);
+        slot->ready = 0;
+        s.written = k + 1;
+        pthread_cond_broadcast(&s.slot_free);
+        pthread_mutex_unlock(&s.lock);
+    }
+    if (failed) stream_fail(&s);
+    for (int i = 0; i < threads; ++i) pthread_join(tid[i], NULL);
+
+    if (binary)
+        failed |= archive_writer_close(&w, (uint64_t)n);
+    else
+        failed |= fclose(fp) != 0;
+    stats->peak_bytes = s.bytes;
+    for (long i = 0; i < s.nslots; ++i) {
+        free(s.slots[i].words);
+        free(s.slots[i].text);
+    }
+    free(s.slots);
+    sieve_base_free(&base);
+    pthread_mutex_destroy(&s.lock);
+    pthread_cond_destroy(&s.slot_free);
+    pthread_cond_destroy(&s.slot_ready);
+    return failed;
+}
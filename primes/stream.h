@@ -0,0 +1,24 @@
+#ifndef STREAM_H_INCLUDED
+#define STREAM_H_INCLUDED
+
+#include <stddef.h>
+
+#include "workqueue.h"
+
+// decimal text never takes more than 3/4 of a byte per integer of range,
+// densest near the start (25 primes under 100 at up to 3 bytes each),
+// this is the bound for one word of bitset
+#define STREAM_TEXT_BOUND (BITSET_WORD_SPAN / 4 * 3)
+
+typedef struct {
+    long count;          // primes < n, including 2
+    size_t slots;        // chunks in flight between producers and writer
+    size_t chunk_words;  // bitset words per chunk, fewer on a tight budget
+    size_t peak_bytes;   // slot memory actually allocated
+    double write_time;   // seconds the writer spent writing
+    double wait_time;    // seconds the writer waited for the next chunk
+} StreamStats;
+
+int stream_primes(long, int, size_t, int, const char*, StreamStats*);
+
+#endif
@@ -0,0 +1,73 @@
+#include "workqueue.h"
+
+#include <stdlib.h>
+
+long work_chunks_for(long n) {
+    // chunks needed to cover the odd numbers in [1, n)
+    return (n - 1 + WORK_CHUNK_SPAN - 1) / WORK_CHUNK_SPAN;
+}
+
+void work_chunk_range(long n, long chunk, long* lo, long* hi) {
+    *lo = 1 + chunk * WORK_CHUNK_SPAN;
+    *hi = *lo + WORK_CHUNK_SPAN < n ? *lo + WORK_CHUNK_SPAN : n;
+}
+
+int workqueue_init(WorkQueue* q, long chunks, int workers) {
+    q->workers = workers;
+    q->deques = (ChunkDeque*)malloc((size_t)workers * sizeof(ChunkDeque));
+    if (!q->deques) return 1;
+    // start with an even contiguous split, stealing fixes any imbalance
+    for (int i = 0; i < workers; ++i) {
+        pthread_mutex_init(&q->deques[i].lock, NULL);
+        q->deques[i].next = chunks * i / workers;
+        q->deques[i].end = chunks * (i + 1) / workers;
+    }
+    return 0;
+}
+
+void workqueue_free(WorkQueue* q) {
+    for (int i = 0; i < q->workers; ++i)
+        pthread_mutex_destroy(&q->deques[i].lock);
+    free(q->deques);
+    q->deques = NULL;
+}
+
+int workqueue_take(WorkQueue* q, int worker, long* chunk, int* stolen) {
+    // next chunk for worker, 0 once every deque is empty
+    ChunkDeque* own = q->deques + worker;
+    *stolen = 0;
+    pthread_mutex_lock(&own->lock);
+    if (own->next < own->end) {
+        *chunk = own->next++;
+        pthread_mutex_unlock(&own->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    // out of work, go round the other workers and take half of what's left
+    for (int i = 1; i < q->workers; ++i) {
+        ChunkDeque* victim = q->deques + (worker + i) % q->workers;
+        long lo, hi;
+        pthread_mutex_lock(&victim->lock);
+        lo = victim->next;
+        hi = victim->end;
+        if (lo < hi) {
+            // victim keeps the front half since it works front to back
+            long mid = lo + (hi - lo) / 2;
+            victim->end = mid;
+            lo = mid;
+        }
+        pthread_mutex_unlock(&victim->lock);
+        if (lo >= hi) continue;
+
+        // keep the first stolen chunk, queue the rest on our own deque
+        pthread_mutex_lock(&own->lock);
+        own->next = lo + 1;
+        own->end = hi;
+        pthread_mutex_unlock(&own->lock);
+        *chunk = lo;
+        *stolen = 1;
+        return 1;
+    }
+    return 0;
+}
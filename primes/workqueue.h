@@ -0,0 +1,33 @@
+#ifndef WORKQUEUE_H_INCLUDED
+#define WORKQUEUE_H_INCLUDED
+
+#include <pthread.h>
+
+#include "sieve.h"
+
+// segments per chunk of work, small enough to balance, big enough that
+// taking a chunk costs nothing next to sieving it
+#define WORK_CHUNK_SEGMENTS 8
+#define WORK_CHUNK_WORDS (WORK_CHUNK_SEGMENTS * SIEVE_SEGMENT_WORDS)
+#define WORK_CHUNK_SPAN (WORK_CHUNK_SEGMENTS * SIEVE_SEGMENT_SPAN)
+
+// chunks [next, end) still to be done by one worker
+// owner takes from the front, thieves split off the back half
+typedef struct {
+    pthread_mutex_t lock;
+    long next;
+    long end;
+} ChunkDeque;
+
+typedef struct {
+    int workers;
+    ChunkDeque* deques;
+} WorkQueue;
+
+long work_chunks_for(long);
+void work_chunk_range(long, long, long*, long*);
+int workqueue_init(WorkQueue*, long, int);
+void workqueue_free(WorkQueue*);
+int workqueue_take(WorkQueue*, int, long*, int*);
+
+#endif